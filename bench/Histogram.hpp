@@ -0,0 +1,56 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Histogram log-liniowy: 32 przedziały na każdą potęgę dwójki (błąd < 3%),
+// liczniki atomowe, więc wiele wątków zapisuje bez blokady. Jednostka dowolna
+// (chat_loadgen: mikrosekundy, db_bench: nanosekundy).
+class Histogram {
+public:
+    void record(uint64_t v) {
+        buckets_[index(v)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(v, std::memory_order_relaxed);
+        uint64_t prev = max_.load(std::memory_order_relaxed);
+        while (v > prev && !max_.compare_exchange_weak(prev, v, std::memory_order_relaxed)) {}
+    }
+    uint64_t count() const { return count_.load(); }
+    double mean() const { uint64_t n = count(); return n ? static_cast<double>(sum_.load()) / static_cast<double>(n) : 0.0; }
+    uint64_t max() const { return max_.load(); }
+    uint64_t percentile(double p) const {
+        uint64_t total = count();
+        if (total == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(std::ceil(p * static_cast<double>(total))), seen = 0;
+        for (std::size_t i = 0; i < kBuckets; ++i) {
+            seen += buckets_[i].load();
+            if (seen >= rank) return std::min(upper(i), max());
+        }
+        return max();
+    }
+
+private:
+    static constexpr int kSubBits = 5;
+    static constexpr std::size_t kBuckets = (64 - kSubBits + 1) << kSubBits;
+
+    static std::size_t index(uint64_t v) {
+        if (v < (1u << kSubBits)) return static_cast<std::size_t>(v);
+        int msb = 63 - __builtin_clzll(v);
+        int shift = msb - kSubBits;
+        return (static_cast<std::size_t>(shift + 1) << kSubBits) + ((v >> shift) & ((1u << kSubBits) - 1));
+    }
+    static uint64_t upper(std::size_t i) {
+        if (i < (1u << kSubBits)) return i;
+        int shift = static_cast<int>(i >> kSubBits) - 1;
+        uint64_t base = (uint64_t(1) << kSubBits) | (i & ((1u << kSubBits) - 1));
+        return ((base + 1) << shift) - 1;
+    }
+
+    std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+};
@@ -0,0 +1,477 @@
+// Generator obciążenia: tysiące równoległych sesji TLS przeciw działającemu serwerowi.
+//
+//   chat_loadgen --sessions 2000 --rate 5000 --duration 30 --mix send=60,send_group=10,history=20,stats=10
+//                [--json wynik.json]
+//
+// Przygotowanie (rejestracja, logowanie, grupy) jest idempotentne - kolejne
+// uruchomienia używają tych samych kont. Obciążenie jest otwarte: każda sesja
+// wysyła żądania w chwilach z procesu Poissona, a opóźnienie liczone jest od
+// zaplanowanej chwili wysłania, więc przeciążony serwer nie zaniża wyników.
+//
+// Wszystkie sesje idą z jednego adresu, więc serwer pod test uruchamiaj bez
+// limitów żądań: --rate-auth 0 --rate-user 0 (i --rate-ip 0, jeśli włączony).
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <nlohmann/json.hpp>
+#include <openssl/ssl.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../common/Protocol.hpp"
+#include "Histogram.hpp"
+
+using boost::asio::ip::tcp;
+namespace ssl = boost::asio::ssl;
+using proto::Op;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+    std::string host = "127.0.0.1";
+    std::string port = "5555";
+    std::size_t sessions = 1000;
+    std::size_t groups = 10;
+    double rate = 1000;        // żądań na sekundę łącznie
+    double duration = 30;      // sekundy pomiaru
+    std::size_t message_size = 64;
+    std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t setup_concurrency = 64;
+    std::string prefix = "lg";
+    std::string password = "loadgen";
+    std::string mix = "send=60,send_group=10,history=20,stats=10";
+    std::string json_path;
+    bool binary = true;
+};
+
+enum Kind { KSend, KSendGroup, KHistory, KStats, KCount, KSetup = KCount };
+const char* kKindNames[KCount] = {"send", "send_group", "history", "stats"};
+
+struct Stats {
+    Histogram latency[KCount];
+    std::atomic<uint64_t> errors[KCount]{};
+    std::atomic<uint64_t> pushes{0};
+    std::atomic<uint64_t> setup_failures{0};
+};
+
+std::string user_name(const Options& o, std::size_t i) { return o.prefix + "_u" + std::to_string(i); }
+std::string group_name(const Options& o, std::size_t i) { return o.prefix + "_g" + std::to_string(i % o.groups); }
+
+class LoadSession : public std::enable_shared_from_this<LoadSession> {
+public:
+    using Callback = std::function<void(const proto::Packet&)>;
+
+    LoadSession(boost::asio::io_context& io, ssl::context& ctx, const Options& opts, Stats& stats, std::size_t index,
+                const std::vector<double>& mix)
+        : stream_(boost::asio::make_strand(io), ctx), timer_(stream_.get_executor()), opts_(opts), stats_(stats),
+          index_(index), rng_(static_cast<uint32_t>(index) * 2654435761u), pick_(mix.begin(), mix.end()) {}
+
+    std::size_t index() const { return index_; }
+    const std::string& user() const { return user_; }
+
+    void connect(const tcp::resolver::results_type& endpoints, std::function<void(bool)> done) {
+        user_ = user_name(opts_, index_);
+        auto self = shared_from_this();
+        boost::asio::async_connect(stream_.next_layer(), endpoints, [this, self, done](boost::system::error_code ec, const tcp::endpoint&) {
+            if (ec) { done(false); return; }
+            if (opts_.binary) SSL_set_alpn_protos(stream_.native_handle(), proto::kAlpnWire, sizeof(proto::kAlpnWire));
+            stream_.async_handshake(ssl::stream_base::client, [this, self, done](boost::system::error_code ec) {
+                if (ec) { done(false); return; }
+                const unsigned char* alpn = nullptr; unsigned int alpn_len = 0;
+                SSL_get0_alpn_selected(stream_.native_handle(), &alpn, &alpn_len);
+                if (alpn && std::string(reinterpret_cast<const char*>(alpn), alpn_len) == proto::kBinaryAlpn) format_ = proto::Format::Binary;
+                read_header();
+                done(true);
+            });
+        });
+    }
+
+    // Żądania idą potokiem; serwer odpowiada po kolei, więc odpowiedź należy
+    // do najstarszego oczekującego. Wywoływane na strandzie sesji.
+    void request(const proto::Packet& p, Kind kind, Clock::time_point scheduled, Callback cb = nullptr) {
+        pending_.push_back({kind, scheduled, std::move(cb)});
+        write(p);
+    }
+
+    // przeciążenie albo limit serwera: warto ponowić po chwili
+    static bool transient(const proto::Packet& r) {
+        return r.op == Op::Error && (r.message == "server busy" || r.message == "rate limited");
+    }
+
+    // Przygotowanie konta: rejestracja ("user exists" też jest w porządku) i logowanie.
+    void login(std::function<void(bool)> done) {
+        proto::Packet reg; reg.op = Op::Register; reg.username = user_; reg.password = opts_.password;
+        auto self = shared_from_this();
+        post([this, self, reg, done]() {
+            request(reg, KSetup, Clock::now(), [this, self, done](const proto::Packet& r) {
+                if (transient(r)) { retry([this, self, done]() { login(done); }); return; }
+                proto::Packet in; in.op = Op::Login; in.username = user_; in.password = opts_.password; in.acks = true;
+                request(in, KSetup, Clock::now(), [this, self, done](const proto::Packet& r) {
+                    if (transient(r)) { retry([this, self, done]() { login(done); }); return; }
+                    done(r.op == Op::Ok);
+                });
+            });
+        });
+    }
+
+    void create_group(std::function<void(bool)> done) {
+        proto::Packet p; p.op = Op::CreateGroup; p.group = group_name(opts_, index_);
+        auto self = shared_from_this();
+        // błąd oznacza, że grupa już istnieje z poprzedniego uruchomienia
+        post([this, self, p, done]() { request(p, KSetup, Clock::now(), [done](const proto::Packet&) { done(true); }); });
+    }
+
+    // Dołączenie tylko gdy jeszcze nie jest członkiem - powtórne uruchomienia nie dublują wierszy.
+    void join_group(std::function<void(bool)> done) {
+        proto::Packet p; p.op = Op::GroupMembers; p.group = group_name(opts_, index_);
+        auto self = shared_from_this();
+        post([this, self, p, done]() {
+            request(p, KSetup, Clock::now(), [this, self, p, done](const proto::Packet& r) {
+                if (std::find(r.members.begin(), r.members.end(), user_) != r.members.end()) { done(true); return; }
+                proto::Packet join = p; join.op = Op::JoinGroup;
+                request(join, KSetup, Clock::now(), [done](const proto::Packet& r) { done(r.op == Op::Ok); });
+            });
+        });
+    }
+
+    void start_load(Clock::time_point until) {
+        auto self = shared_from_this();
+        post([this, self, until]() {
+            until_ = until;
+            next_at_ = Clock::now();
+            schedule();
+        });
+    }
+
+    std::size_t outstanding() const { return outstanding_.load(); }
+
+    void shutdown() {
+        auto self = shared_from_this();
+        post([this, self]() {
+            boost::system::error_code ignored;
+            timer_.cancel();
+            stream_.lowest_layer().close(ignored);
+        });
+    }
+
+private:
+    struct Pending {
+        Kind kind;
+        Clock::time_point scheduled;
+        Callback cb;
+    };
+
+    template <class F>
+    void post(F&& f) { boost::asio::post(stream_.get_executor(), std::forward<F>(f)); }
+
+    void retry(std::function<void()> f) {
+        auto self = shared_from_this();
+        timer_.expires_after(std::chrono::milliseconds(50 + rng_() % 200));
+        timer_.async_wait([self, f](boost::system::error_code ec) { if (!ec) f(); });
+    }
+
+    void schedule() {
+        std::exponential_distribution<double> gap(opts_.rate / static_cast<double>(opts_.sessions));
+        next_at_ += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(gap(rng_)));
+        if (next_at_ >= until_) return;
+        auto self = shared_from_this();
+        timer_.expires_at(next_at_);
+        timer_.async_wait([this, self](boost::system::error_code ec) {
+            if (ec) return;
+            fire(next_at_);
+            schedule();
+        });
+    }
+
+    void fire(Clock::time_point scheduled) {
+        Kind kind = static_cast<Kind>(pick_(rng_));
+        proto::Packet p;
+        switch (kind) {
+        case KSend: {
+            std::size_t peer = (index_ + 1 + rng_() % std::max<std::size_t>(1, opts_.sessions - 1)) % opts_.sessions;
+            p.op = Op::Send; p.to = user_name(opts_, peer); p.message.assign(opts_.message_size, 'x');
+            break;
+        }
+        case KSendGroup: p.op = Op::SendGroup; p.group = group_name(opts_, index_); p.message.assign(opts_.message_size, 'x'); break;
+        case KHistory: p.op = Op::History; break;
+        default: p.op = Op::Stats; break;
+        }
+        outstanding_.fetch_add(1);
+        request(p, kind, scheduled);
+    }
+
+    void write(const proto::Packet& p) {
+        std::string payload = proto::encode(p, format_);
+        uint32_t len = htonl(static_cast<uint32_t>(payload.size()));
+        auto frame = std::make_shared<std::string>(reinterpret_cast<const char*>(&len), 4);
+        frame->append(payload);
+        out_.push_back(std::move(frame));
+        if (out_.size() == 1) write_next();
+    }
+
+    void write_next() {
+        auto self = shared_from_this();
+        boost::asio::async_write(stream_, boost::asio::buffer(*out_.front()), [this, self](boost::system::error_code ec, std::size_t) {
+            if (ec) return;
+            out_.pop_front();
+            if (!out_.empty()) write_next();
+        });
+    }
+
+    void read_header() {
+        auto self = shared_from_this();
+        boost::asio::async_read(stream_, boost::asio::buffer(header_), [this, self](boost::system::error_code ec, std::size_t) {
+            if (ec) return;
+            uint32_t len; std::memcpy(&len, header_.data(), 4);
+            body_.resize(ntohl(len));
+            boost::asio::async_read(stream_, boost::asio::buffer(body_), [this, self](boost::system::error_code ec, std::size_t) {
+                if (ec) return;
+                on_frame();
+                read_header();
+            });
+        });
+    }
+
+    void on_frame() {
+        proto::Packet r;
+        try { r = proto::decode_response(body_.data(), body_.size(), format_); }
+        catch (const proto::DecodeError&) { r.op = Op::Error; }
+        if (r.op == Op::Message) {
+            stats_.pushes.fetch_add(1, std::memory_order_relaxed);
+            push_last_ = r.id;
+            return;
+        }
+        if (r.op == Op::Ping) {
+            proto::Packet pong; pong.op = Op::Pong;
+            write(pong);
+            return;
+        }
+        if (pending_.empty()) return;
+        Pending p = std::move(pending_.front());
+        pending_.pop_front();
+        if (p.kind != KSetup) {
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - p.scheduled).count();
+            stats_.latency[p.kind].record(static_cast<uint64_t>(std::max<int64_t>(0, us)));
+            if (r.op == Op::Error) stats_.errors[p.kind].fetch_add(1, std::memory_order_relaxed);
+            outstanding_.fetch_sub(1);
+        }
+        // potwierdzamy odebrane wiadomości, żeby nie rosła kolejka niedostarczonych
+        if (push_last_ != push_acked_) {
+            proto::Packet ack; ack.op = Op::Ack; ack.id = push_last_;
+            push_acked_ = push_last_;
+            write(ack);
+        }
+        if (p.cb) p.cb(r);
+    }
+
+    ssl::stream<tcp::socket> stream_;
+    boost::asio::steady_timer timer_;
+    const Options& opts_;
+    Stats& stats_;
+    std::size_t index_;
+    std::string user_;
+    proto::Format format_ = proto::Format::Json;
+    std::mt19937 rng_;
+    std::discrete_distribution<int> pick_;
+
+    std::array<char, 4> header_{};
+    std::vector<char> body_;
+    std::deque<std::shared_ptr<std::string>> out_;
+    std::deque<Pending> pending_;
+    std::atomic<std::size_t> outstanding_{0};
+    int64_t push_last_ = 0; // ostatnio odebrana (Ack potwierdza ją i wszystko przed nią)
+    int64_t push_acked_ = 0;
+    Clock::time_point next_at_;
+    Clock::time_point until_;
+};
+
+// Faza przygotowania: step dla każdej wybranej sesji, najwyżej setup_concurrency naraz.
+class Phase {
+public:
+    using Step = std::function<void(LoadSession&, std::function<void(bool)>)>;
+
+    static void run(std::vector<std::shared_ptr<LoadSession>>& sessions, std::size_t concurrency, Step step) {
+        Phase phase(sessions, step);
+        std::unique_lock<std::mutex> lock(phase.mu_);
+        for (std::size_t i = 0; i < std::min(concurrency, sessions.size()); ++i) phase.launch_locked();
+        phase.cv_.wait(lock, [&]() { return phase.finished_ == sessions.size(); });
+    }
+
+private:
+    Phase(std::vector<std::shared_ptr<LoadSession>>& sessions, Step step) : sessions_(sessions), step_(std::move(step)) {}
+
+    void launch_locked() {
+        if (next_ >= sessions_.size()) return;
+        auto& s = *sessions_[next_++];
+        step_(s, [this](bool) {
+            std::lock_guard<std::mutex> lock(mu_);
+            ++finished_;
+            launch_locked();
+            cv_.notify_all();
+        });
+    }
+
+    std::vector<std::shared_ptr<LoadSession>>& sessions_;
+    Step step_;
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::size_t next_ = 0;
+    std::size_t finished_ = 0;
+};
+
+Options parse_options(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--json-format") { o.binary = false; continue; }
+        if (i + 1 >= argc) throw std::invalid_argument("missing value for " + arg);
+        std::string val = argv[++i];
+        if (arg == "--host") o.host = val;
+        else if (arg == "--port") o.port = val;
+        else if (arg == "--sessions") o.sessions = std::stoul(val);
+        else if (arg == "--groups") o.groups = std::stoul(val);
+        else if (arg == "--rate") o.rate = std::stod(val);
+        else if (arg == "--duration") o.duration = std::stod(val);
+        else if (arg == "--message-size") o.message_size = std::stoul(val);
+        else if (arg == "--threads") o.threads = std::stoul(val);
+        else if (arg == "--setup-concurrency") o.setup_concurrency = std::stoul(val);
+        else if (arg == "--prefix") o.prefix = val;
+        else if (arg == "--mix") o.mix = val;
+        else if (arg == "--json") o.json_path = val;
+        else throw std::invalid_argument("unknown option " + arg);
+    }
+    if (o.sessions < 2 || o.groups < 1 || o.rate <= 0 || o.threads < 1) throw std::invalid_argument("invalid sessions/groups/rate/threads");
+    o.groups = std::min(o.groups, o.sessions);
+    return o;
+}
+
+// "send=60,history=40" -> wagi w kolejności Kind
+std::vector<double> parse_mix(const std::string& mix) {
+    std::vector<double> weights(KCount, 0.0);
+    std::size_t pos = 0;
+    while (pos < mix.size()) {
+        std::size_t end = mix.find(',', pos);
+        if (end == std::string::npos) end = mix.size();
+        std::string item = mix.substr(pos, end - pos);
+        std::size_t eq = item.find('=');
+        auto name = item.substr(0, eq);
+        auto it = std::find_if(std::begin(kKindNames), std::end(kKindNames), [&](const char* n) { return name == n; });
+        if (eq == std::string::npos || it == std::end(kKindNames)) throw std::invalid_argument("invalid mix entry " + item);
+        weights[it - std::begin(kKindNames)] = std::stod(item.substr(eq + 1));
+        pos = end + 1;
+    }
+    if (std::all_of(weights.begin(), weights.end(), [](double w) { return w <= 0; })) throw std::invalid_argument("empty mix");
+    return weights;
+}
+
+void raise_fd_limit() {
+    rlimit rl{};
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        Options opts = parse_options(argc, argv);
+        auto weights = parse_mix(opts.mix);
+        raise_fd_limit();
+
+        boost::asio::io_context io;
+        auto guard = boost::asio::make_work_guard(io);
+        std::vector<std::thread> threads;
+        for (std::size_t i = 0; i < opts.threads; ++i) threads.emplace_back([&io]() { io.run(); });
+
+        ssl::context ctx(ssl::context::tls_client);
+        ctx.set_verify_mode(ssl::verify_none);
+        Stats stats;
+        std::vector<std::shared_ptr<LoadSession>> sessions;
+        for (std::size_t i = 0; i < opts.sessions; ++i) {
+            sessions.push_back(std::make_shared<LoadSession>(io, ctx, opts, stats, i, weights));
+        }
+        auto endpoints = tcp::resolver(io).resolve(opts.host, opts.port);
+
+        auto setup_start = Clock::now();
+        auto counted = [&stats](std::function<void(bool)> done) {
+            return [&stats, done](bool ok) { if (!ok) stats.setup_failures.fetch_add(1); done(ok); };
+        };
+        Phase::run(sessions, opts.setup_concurrency, [&](LoadSession& s, auto done) {
+            s.connect(endpoints, [&s, done = counted(done)](bool ok) { if (ok) s.login(done); else done(false); });
+        });
+        std::vector<std::shared_ptr<LoadSession>> owners(sessions.begin(), sessions.begin() + opts.groups);
+        Phase::run(owners, opts.setup_concurrency, [](LoadSession& s, auto done) { s.create_group(done); });
+        Phase::run(sessions, opts.setup_concurrency, [&](LoadSession& s, auto done) { s.join_group(counted(done)); });
+        double setup_s = std::chrono::duration<double>(Clock::now() - setup_start).count();
+        std::cerr << "Setup: " << opts.sessions << " sessions in " << setup_s << " s, failures: " << stats.setup_failures.load() << "\n";
+
+        auto load_start = Clock::now();
+        auto until = load_start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opts.duration));
+        for (auto& s : sessions) s->start_load(until);
+        std::this_thread::sleep_until(until);
+        // odpowiedzi na żądania wysłane przed końcem, najwyżej 10 s
+        auto drain_deadline = Clock::now() + std::chrono::seconds(10);
+        auto outstanding = [&]() { std::size_t n = 0; for (auto& s : sessions) n += s->outstanding(); return n; };
+        while (outstanding() > 0 && Clock::now() < drain_deadline) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        double elapsed = std::chrono::duration<double>(Clock::now() - load_start).count();
+        std::size_t timed_out = outstanding();
+
+        for (auto& s : sessions) s->shutdown();
+        guard.reset();
+        io.stop();
+        for (auto& t : threads) t.join();
+
+        nlohmann::json out;
+        out["config"] = {{"sessions", opts.sessions}, {"groups", opts.groups}, {"rate", opts.rate}, {"duration_s", opts.duration},
+                         {"message_size", opts.message_size}, {"mix", opts.mix}, {"format", opts.binary ? "binary" : "json"}};
+        out["setup_s"] = setup_s;
+        out["setup_failures"] = stats.setup_failures.load();
+        out["elapsed_s"] = elapsed;
+        out["timed_out"] = timed_out;
+        out["pushes_received"] = stats.pushes.load();
+        std::printf("%-12s %10s %10s %8s %10s %10s %10s %10s\n", "type", "count", "req/s", "errors", "p50_us", "p99_us", "p999_us", "max_us");
+        uint64_t total = 0;
+        for (int k = 0; k < KCount; ++k) {
+            const auto& h = stats.latency[k];
+            uint64_t n = h.count();
+            total += n;
+            if (n == 0 && weights[k] <= 0) continue;
+            double rps = static_cast<double>(n) / elapsed;
+            std::printf("%-12s %10llu %10.1f %8llu %10llu %10llu %10llu %10llu\n", kKindNames[k], (unsigned long long)n, rps,
+                        (unsigned long long)stats.errors[k].load(), (unsigned long long)h.percentile(0.5),
+                        (unsigned long long)h.percentile(0.99), (unsigned long long)h.percentile(0.999), (unsigned long long)h.max());
+            out["requests"][kKindNames[k]] = {{"count", n}, {"throughput", rps}, {"errors", stats.errors[k].load()},
+                                              {"p50_us", h.percentile(0.5)}, {"p99_us", h.percentile(0.99)},
+                                              {"p999_us", h.percentile(0.999)}, {"max_us", h.max()}};
+        }
+        out["throughput"] = static_cast<double>(total) / elapsed;
+        std::printf("total: %.1f req/s, pushes received: %llu, unanswered: %zu\n", static_cast<double>(total) / elapsed,
+                    (unsigned long long)stats.pushes.load(), timed_out);
+        if (!opts.json_path.empty()) {
+            std::ofstream f(opts.json_path);
+            f << out.dump(2) << "\n";
+        }
+        return timed_out == 0 ? 0 : 2;
+    } catch (std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,273 @@
+// Mikrobenchmark warstwy Database na wygenerowanych zbiorach danych.
+//
+//   db_bench --messages 10000,100000,1000000 --users 1000 --groups 50 --group-size 20
+//            --size uniform:16:512 --group-ratio 0.1 --undelivered 0.02 [--json wynik.json]
+//
+// Zbiory są zapisywane w --dir i używane ponownie przy tych samych parametrach
+// (10M wiadomości generuje się kilka minut). Odczyty idą po zatwierdzonym zbiorze;
+// zapisy (save_*, mark_delivered) w jednej transakcji wycofywanej na końcu, więc
+// zbiór zostaje nietknięty między uruchomieniami, a koszt COMMIT/fsync nie wchodzi
+// do wyniku - ten mierzy chat_loadgen.
+#include <nlohmann/json.hpp>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../server/db/Database.hpp"
+#include "Histogram.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+    std::vector<long long> messages = {10000, 100000, 1000000};
+    std::size_t users = 1000;
+    std::size_t groups = 50;
+    std::size_t group_size = 20;
+    double group_ratio = 0.1;     // udział wiadomości grupowych
+    double undelivered = 0.02;    // ostatnie wiadomości zostają niedostarczone
+    std::string size = "uniform:16:512";
+    std::size_t iterations = 2000;
+    std::string dir = ".";
+    std::string json_path;
+    bool cache = false;           // domyślnie mierzymy SQL, nie cache
+};
+
+// "fixed:N", "uniform:MIN:MAX", "lognormal:MEDIAN:SIGMA"
+class SizeDistribution {
+public:
+    explicit SizeDistribution(const std::string& spec) : spec_(spec) {
+        std::istringstream in(spec);
+        std::getline(in, kind_, ':');
+        std::string a, b;
+        std::getline(in, a, ':');
+        std::getline(in, b, ':');
+        if (kind_ == "fixed" && !a.empty()) { p1_ = std::stod(a); return; }
+        if ((kind_ == "uniform" || kind_ == "lognormal") && !a.empty() && !b.empty()) { p1_ = std::stod(a); p2_ = std::stod(b); return; }
+        throw std::invalid_argument("invalid size distribution " + spec);
+    }
+    std::size_t operator()(std::mt19937_64& rng) const {
+        double v = p1_;
+        if (kind_ == "uniform") v = std::uniform_real_distribution<double>(p1_, p2_)(rng);
+        else if (kind_ == "lognormal") v = std::lognormal_distribution<double>(std::log(p1_), p2_)(rng);
+        return static_cast<std::size_t>(std::clamp(v, 1.0, static_cast<double>(1 << 20)));
+    }
+    const std::string& spec() const { return spec_; }
+
+private:
+    std::string spec_, kind_;
+    double p1_ = 0, p2_ = 0;
+};
+
+std::string user_name(std::size_t i) { return "u" + std::to_string(i); }
+std::string group_name(std::size_t i) { return "g" + std::to_string(i); }
+
+std::vector<long long> parse_list(const std::string& s) {
+    std::vector<long long> out;
+    std::istringstream in(s);
+    for (std::string item; std::getline(in, item, ',');) out.push_back(std::stoll(item));
+    return out;
+}
+
+Options parse_options(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--cache") { o.cache = true; continue; }
+        if (i + 1 >= argc) throw std::invalid_argument("missing value for " + arg);
+        std::string val = argv[++i];
+        if (arg == "--messages") o.messages = parse_list(val);
+        else if (arg == "--users") o.users = std::stoul(val);
+        else if (arg == "--groups") o.groups = std::stoul(val);
+        else if (arg == "--group-size") o.group_size = std::stoul(val);
+        else if (arg == "--group-ratio") o.group_ratio = std::stod(val);
+        else if (arg == "--undelivered") o.undelivered = std::stod(val);
+        else if (arg == "--size") o.size = val;
+        else if (arg == "--iterations") o.iterations = std::stoul(val);
+        else if (arg == "--dir") o.dir = val;
+        else if (arg == "--json") o.json_path = val;
+        else throw std::invalid_argument("unknown option " + arg);
+    }
+    if (o.users < 2 || o.iterations < 1 || o.messages.empty()) throw std::invalid_argument("invalid users/iterations/messages");
+    if (o.groups == 0) o.group_ratio = 0;
+    o.group_size = std::min(o.group_size, o.users);
+    return o;
+}
+
+DatabaseOptions db_options(const Options& o, const char* synchronous) {
+    DatabaseOptions d;
+    d.synchronous = synchronous;
+    if (!o.cache) d.cache_users = d.cache_groups = 0;
+    return d;
+}
+
+// Zbiór: użytkownicy, grupy, wiadomości bezpośrednie i grupowe w proporcji group_ratio,
+// na końcu wszystko dostarczone poza ostatnim ułamkiem `undelivered`.
+void generate(const Options& o, const std::string& path, long long messages) {
+    std::remove(path.c_str());
+    Database db(path, db_options(o, "OFF"));
+    std::mt19937_64 rng(42);
+    SizeDistribution size(o.size);
+    std::uniform_int_distribution<std::size_t> pick_user(0, o.users - 1);
+    std::vector<unsigned char> salt(16, 1), hash(32, 2);
+
+    db.begin();
+    for (std::size_t u = 0; u < o.users; ++u) db.create_user(user_name(u), salt, hash, 1);
+    std::vector<std::vector<std::size_t>> members(o.groups);
+    for (std::size_t g = 0; g < o.groups; ++g) {
+        db.create_group(group_name(g));
+        std::vector<std::size_t> all(o.users);
+        for (std::size_t u = 0; u < o.users; ++u) all[u] = u;
+        std::shuffle(all.begin(), all.end(), rng);
+        members[g].assign(all.begin(), all.begin() + o.group_size);
+        for (auto u : members[g]) db.add_to_group(group_name(g), user_name(u));
+    }
+    db.commit();
+
+    std::bernoulli_distribution is_group(o.group_ratio);
+    std::string content;
+    long long cut = static_cast<long long>(static_cast<double>(messages) * (1.0 - o.undelivered));
+    auto started = Clock::now();
+    db.begin();
+    for (long long i = 1; i <= messages; ++i) {
+        content.assign(size(rng), 'x');
+        if (is_group(rng)) {
+            std::size_t g = rng() % o.groups;
+            db.save_group_message(user_name(members[g][rng() % members[g].size()]), group_name(g), content);
+        } else {
+            std::size_t from = pick_user(rng), to = (from + 1 + rng() % (o.users - 1)) % o.users;
+            db.save_message(user_name(from), user_name(to), content);
+        }
+        // id wiadomości = i (świeża baza, AUTOINCREMENT)
+        if (i == cut) {
+            for (std::size_t u = 0; u < o.users; ++u) db.mark_delivered(user_name(u), cut);
+        }
+        if (i % 100000 == 0) {
+            db.commit();
+            db.begin();
+            std::cerr << "\r  generated " << i << "/" << messages << std::flush;
+        }
+    }
+    db.commit();
+    std::cerr << "\r  generated " << messages << " messages in "
+              << std::chrono::duration<double>(Clock::now() - started).count() << " s\n";
+}
+
+struct Result {
+    std::string op;
+    Histogram ns;
+};
+
+template <class F>
+void measure(Result& r, std::size_t iterations, F&& f) {
+    for (std::size_t i = 0; i < iterations; ++i) {
+        auto t0 = Clock::now();
+        f(i);
+        r.ns.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count()));
+    }
+}
+
+nlohmann::json run(const Options& o, long long messages) {
+    std::ostringstream name;
+    name << "db_bench_" << messages << "_" << o.users << "_" << o.groups << "x" << o.group_size << "_"
+         << o.group_ratio << "_" << o.undelivered << "_" << o.size << ".db";
+    std::string file = name.str();
+    std::replace(file.begin(), file.end(), ':', '-');
+    std::string path = o.dir + "/" + file;
+    struct stat st{};
+    if (stat(path.c_str(), &st) != 0) {
+        std::cerr << "Generating " << path << "\n";
+        generate(o, path, messages);
+    }
+
+    Database db(path, db_options(o, "NORMAL"));
+    std::mt19937_64 rng(7);
+    SizeDistribution size(o.size);
+    auto user = [&]() { return user_name(rng() % o.users); };
+    auto group = [&]() { return group_name(rng() % std::max<std::size_t>(1, o.groups)); };
+    std::uniform_int_distribution<long long> pick_id(1, messages);
+    std::vector<std::unique_ptr<Result>> results;
+    auto result = [&](const char* op) -> Result& {
+        results.push_back(std::make_unique<Result>());
+        results.back()->op = op;
+        return *results.back();
+    };
+    std::size_t n = o.iterations;
+
+    // odczyty po zatwierdzonym zbiorze (pula czytelników)
+    measure(result("get_history"), n, [&](std::size_t) { db.get_history(user(), 0, 20); });
+    measure(result("get_history_deep"), n, [&](std::size_t) { db.get_history(user(), pick_id(rng), 20); });
+    measure(result("get_undelivered"), n, [&](std::size_t) { db.get_undelivered(user(), 0, 256); });
+    measure(result("get_stats"), n, [&](std::size_t) { db.get_stats(user()); });
+    if (o.groups) measure(result("get_group_members"), n, [&](std::size_t) { db.get_group_members(group()); });
+
+    // zapisy w jednej transakcji, wycofanej na końcu
+    std::string content;
+    db.begin();
+    Result& save = result("save_message");
+    for (std::size_t i = 0; i < n; ++i) {
+        content.assign(size(rng), 'x');
+        std::string from = user(), to = user();
+        if (from == to) to = user_name((std::stoul(from.substr(1)) + 1) % o.users);
+        auto t0 = Clock::now();
+        db.save_message(from, to, content);
+        save.ns.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count()));
+    }
+    if (o.groups) {
+        Result& save_group = result("save_group_message");
+        for (std::size_t i = 0; i < n; ++i) {
+            content.assign(size(rng), 'x');
+            std::string from = user(), g = group();
+            auto t0 = Clock::now();
+            db.save_group_message(from, g, content);
+            save_group.ns.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count()));
+        }
+    }
+    measure(result("mark_delivered"), n, [&](std::size_t) { db.mark_delivered(user(), messages); });
+    db.rollback();
+
+    std::printf("\n%lld messages, %zu users, %zu groups x %zu, sizes %s\n", messages, o.users, o.groups, o.group_size, o.size.c_str());
+    std::printf("%-20s %10s %10s %10s %10s %10s %12s\n", "op", "mean_ns", "p50_ns", "p99_ns", "p999_ns", "max_ns", "ops/s");
+    nlohmann::json ops;
+    for (const auto& r : results) {
+        const auto& h = r->ns;
+        double ops_s = h.mean() > 0 ? 1e9 / h.mean() : 0;
+        std::printf("%-20s %10.0f %10llu %10llu %10llu %10llu %12.0f\n", r->op.c_str(), h.mean(), (unsigned long long)h.percentile(0.5),
+                    (unsigned long long)h.percentile(0.99), (unsigned long long)h.percentile(0.999), (unsigned long long)h.max(), ops_s);
+        ops[r->op] = {{"count", h.count()}, {"mean_ns", h.mean()}, {"p50_ns", h.percentile(0.5)}, {"p99_ns", h.percentile(0.99)},
+                      {"p999_ns", h.percentile(0.999)}, {"max_ns", h.max()}, {"ops_per_s", ops_s}};
+    }
+    return {{"messages", messages}, {"ops", ops}};
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        Options opts = parse_options(argc, argv);
+        nlohmann::json out;
+        out["config"] = {{"users", opts.users}, {"groups", opts.groups}, {"group_size", opts.group_size},
+                         {"group_ratio", opts.group_ratio}, {"undelivered", opts.undelivered}, {"size", opts.size},
+                         {"iterations", opts.iterations}, {"cache", opts.cache}};
+        out["datasets"] = nlohmann::json::array();
+        for (long long m : opts.messages) out["datasets"].push_back(run(opts, m));
+        if (!opts.json_path.empty()) {
+            std::ofstream f(opts.json_path);
+            f << out.dump(2) << "\n";
+        }
+    } catch (std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
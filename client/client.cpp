@@ -5,13 +5,18 @@
 #include <vector>
 #include <array>
 #include <cstring>
+#include <deque>
+#include <memory>
+#include <optional>
 #include <sstream>
-#include <nlohmann/json.hpp>
+#include <openssl/ssl.h>
+
+#include "../common/Protocol.hpp"
 
 using boost::asio::ip::tcp;
 using boost::asio::ip::udp;
 namespace ssl = boost::asio::ssl;
-using json = nlohmann::json;
+using proto::Op;
 
 std::string discover_server(boost::asio::io_context& io) {
     udp::socket sock(io, udp::v4());
@@ -27,80 +32,213 @@ std::string discover_server(boost::asio::io_context& io) {
 
 class Client {
 public:
-    explicit Client(boost::asio::io_context& io) : ssl_ctx_(ssl::context::tls_client), stream_(io, ssl_ctx_) {
+    explicit Client(boost::asio::io_context& io)
+        : io_(io), ssl_ctx_(ssl::context::tls_client), ack_timer_(io), reconnect_timer_(io), session_(nullptr, SSL_SESSION_free) {
         ssl_ctx_.set_verify_mode(ssl::verify_none);
+        SSL_CTX* ctx = ssl_ctx_.native_handle();
+        SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+        // Bilet od serwera (w TLS 1.3 przychodzi już po handshake) trzymamy w session_
+        // i oferujemy przy ponownym połączeniu - wznowienie omija podpis i wymianę certyfikatu.
+        // (app_data kontekstu zajmuje boost::asio na callback weryfikacji)
+        SSL_CTX_set_ex_data(ctx, ex_index(), this);
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx, [](SSL* ssl, SSL_SESSION* sess) {
+            if (!SSL_SESSION_is_resumable(sess)) return 0;
+            static_cast<Client*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ex_index()))->session_.reset(sess);
+            return 1;
+        });
     }
 
     void connect(const std::string& host, const std::string& port) {
-        tcp::resolver resolver(stream_.get_executor());
-        boost::asio::connect(stream_.next_layer(), resolver.resolve(host, port));
-        stream_.handshake(ssl::stream_base::client);
-        read_header();
+        host_ = host;
+        port_ = port;
+        open();
     }
 
-    void send(const json& j) {
-        std::string msg = j.dump();
-        uint32_t len = htonl(static_cast<uint32_t>(msg.size()));
-        std::vector<boost::asio::const_buffer> bufs{ boost::asio::buffer(&len, 4), boost::asio::buffer(msg) };
-        boost::asio::async_write(stream_, bufs, [](boost::system::error_code, std::size_t) {});
+    // wołane z wątku stdin, a strumień obsługuje wątek io - zapis przechodzi przez post
+    void send(const proto::Packet& p) {
+        boost::asio::post(io_, [this, p]() {
+            if (p.op == Op::Login) { login_ = p; login_->acks = true; } // powtarzany po ponownym połączeniu
+            out_.push_back(frame(p));
+            if (connected_ && !writing_) write_next();
+        });
     }
 
 private:
-    void read_header() {
-        boost::asio::async_read(stream_, boost::asio::buffer(header_), [this](boost::system::error_code ec, std::size_t) {
-            if (!ec) {
-                uint32_t len; std::memcpy(&len, header_.data(), 4);
-                read_body(ntohl(len));
+    static int ex_index() {
+        static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+        return index;
+    }
+
+    // Synchronicznie: pierwszy raz z main, potem z wątku io przy ponownym łączeniu.
+    void open() {
+        ++conn_;
+        stream_.emplace(io_, ssl_ctx_);
+        tcp::resolver resolver(io_);
+        boost::asio::connect(stream_->next_layer(), resolver.resolve(host_, port_));
+        SSL* ssl = stream_->native_handle();
+        // proponujemy protokół binarny; stary serwer bez ALPN zostanie przy JSON
+        SSL_set_alpn_protos(ssl, proto::kAlpnWire, sizeof(proto::kAlpnWire));
+        if (session_) SSL_set_session(ssl, session_.get());
+        stream_->handshake(ssl::stream_base::client);
+        resumed_ = SSL_session_reused(ssl);
+        const unsigned char* alpn = nullptr; unsigned int alpn_len = 0;
+        SSL_get0_alpn_selected(ssl, &alpn, &alpn_len);
+        format_ = alpn && std::string(reinterpret_cast<const char*>(alpn), alpn_len) == proto::kBinaryAlpn ? proto::Format::Binary : proto::Format::Json;
+        connected_ = true;
+        read_header();
+    }
+
+    void on_disconnect() {
+        if (!connected_) return;
+        connected_ = false;
+        // bez tego OpenSSL uzna przerwaną sesję za niewznawialną i wyrzuci nasz bilet
+        SSL* ssl = stream_->native_handle();
+        if (SSL_is_init_finished(ssl)) SSL_set_shutdown(ssl, SSL_get_shutdown(ssl) | SSL_SENT_SHUTDOWN);
+        boost::system::error_code ignored;
+        stream_->lowest_layer().close(ignored);
+        std::cout << "\n\033[1;31mRozłączono, ponowne łączenie...\033[0m\n" << std::flush;
+        schedule_reconnect(std::chrono::seconds(1));
+    }
+
+    void schedule_reconnect(std::chrono::seconds delay) {
+        reconnect_timer_.expires_after(delay);
+        reconnect_timer_.async_wait([this, delay](boost::system::error_code ec) {
+            if (ec) return;
+            // przerwany zapis musi najpierw oddać bufor starego strumienia
+            if (writing_) { schedule_reconnect(delay); return; }
+            try {
+                open();
+            } catch (const std::exception&) {
+                schedule_reconnect(std::min(delay * 2, std::chrono::seconds(30)));
+                return;
             }
+            std::cout << "\n\033[1;32mPołączono ponownie" << (resumed_ ? " (sesja TLS wznowiona)" : "") << "\033[0m\n" << std::flush;
+            // nowa sesja serwera zna tylko swoje id
+            last_id_ = 0;
+            if (login_) out_.push_front(frame(*login_));
+            if (!out_.empty()) write_next();
+        });
+    }
+
+    std::shared_ptr<std::string> frame(const proto::Packet& p) const {
+        std::string payload = proto::encode(p, format_);
+        uint32_t len = htonl(static_cast<uint32_t>(payload.size()));
+        auto msg = std::make_shared<std::string>(reinterpret_cast<const char*>(&len), 4);
+        msg->append(payload);
+        return msg;
+    }
+
+    // ssl::stream nie pozwala na dwa równoległe async_write; przerwana ramka zostaje
+    // w out_ i idzie ponownie po połączeniu
+    void write_next() {
+        writing_ = true;
+        auto msg = out_.front();
+        boost::asio::async_write(*stream_, boost::asio::buffer(*msg), [this, msg, conn = conn_](boost::system::error_code ec, std::size_t) {
+            writing_ = false;
+            if (conn != conn_) return;
+            if (ec) { on_disconnect(); return; }
+            out_.pop_front();
+            if (!out_.empty()) write_next();
+        });
+    }
+
+    // Potwierdzenia zbiorcze: id ostatnio odebranej wiadomości (nie największe -
+    // wiadomości na żywo przychodzą w dowolnej kolejności), najwyżej raz na 200 ms.
+    void schedule_ack(int64_t id) {
+        last_id_ = id;
+        if (ack_armed_) return;
+        ack_armed_ = true;
+        ack_timer_.expires_after(std::chrono::milliseconds(200));
+        ack_timer_.async_wait([this](boost::system::error_code ec) {
+            ack_armed_ = false;
+            if (ec) return;
+            proto::Packet ack; ack.op = Op::Ack; ack.id = last_id_;
+            send(ack);
+        });
+    }
+
+    void read_header() {
+        boost::asio::async_read(*stream_, boost::asio::buffer(header_), [this, conn = conn_](boost::system::error_code ec, std::size_t) {
+            if (conn != conn_) return;
+            if (ec) { on_disconnect(); return; }
+            uint32_t len; std::memcpy(&len, header_.data(), 4);
+            read_body(ntohl(len));
         });
     }
 
     void read_body(std::size_t len) {
         body_.resize(len);
-        boost::asio::async_read(stream_, boost::asio::buffer(body_), [this](boost::system::error_code ec, std::size_t) {
-            if (!ec) {
-                std::string s(body_.begin(), body_.end());
-                try {
-                    json res = json::parse(s);
-                    std::string t = res.value("type", "");
-
-                    if (t == "message") {
-                        std::cout << "\n\033[1;32m[" << res.value("from", "System") << "]\033[0m: " << res.value("message", "") << "\n";
-                    } 
-                    else if (t == "stats") {
-                        std::cout << "\n\033[1;34m╔════════ STATYSTYKI ════════╗\033[0m\n " << res.value("data", "") << "\n\033[1;34m╚════════════════════════════╝\033[0m\n";
-                    } 
-                    else if (t == "group_members") {
-                        std::cout << "\n\033[1;33m Członkowie grupy " << res.value("group", "") << ":\033[0m ";
-                        for(auto& m : res["members"]) std::cout << m.get<std::string>() << " ";
-                        std::cout << "\n";
-                    }
-                    else if (t == "history") {
-                        std::cout << "\n\033[1;36m--- HISTORIA WIADOMOŚCI ---\033[0m\n";
-                        for (auto& m : res["messages"]) {
-                            std::cout << "[" << m.value("ts", "") << "] " << m.value("from", "") << " -> " << m.value("to", "") << ": " << m.value("message", "") << "\n";
-                        }
-                    }
-                    else if (t == "ok") {
-                        std::cout << "\n\033[1;32m[OK]:\033[0m " << res.value("message", "Operacja powiodła się") << "\n";
-                    }
-                    else if (t == "error") {
-                        std::cout << "\n\033[1;31m[BŁĄD]:\033[0m " << res.value("message", "Nieznany błąd") << "\n";
+        boost::asio::async_read(*stream_, boost::asio::buffer(body_), [this, conn = conn_](boost::system::error_code ec, std::size_t) {
+            if (conn != conn_) return;
+            if (ec) { on_disconnect(); return; }
+            try {
+                proto::Packet res = proto::decode_response(body_.data(), body_.size(), format_);
+
+                if (res.op == Op::Ping) {
+                    proto::Packet pong; pong.op = Op::Pong;
+                    send(pong);
+                }
+                else if (res.op == Op::Message) {
+                    if (res.id) schedule_ack(res.id);
+                    std::cout << "\n\033[1;32m[" << (res.from.empty() ? "System" : res.from) << "]\033[0m: " << res.message << "\n";
+                } 
+                else if (res.op == Op::StatsResult) {
+                    std::cout << "\n\033[1;34m╔════════ STATYSTYKI ════════╗\033[0m\n " << res.data << "\n\033[1;34m╚════════════════════════════╝\033[0m\n";
+                } 
+                else if (res.op == Op::GroupMembersResult) {
+                    std::cout << "\n\033[1;33m Członkowie grupy " << res.group << ":\033[0m ";
+                    for (auto& m : res.members) std::cout << m << " ";
+                    std::cout << "\n";
+                }
+                else if (res.op == Op::HistoryResult) {
+                    std::cout << "\n\033[1;36m--- HISTORIA WIADOMOŚCI ---\033[0m\n";
+                    for (auto& m : res.messages) {
+                        std::cout << "#" << m.id << " [" << m.ts << "] " << m.from << " -> " << m.to << ": " << m.message << "\n";
                     }
-                    else {
-                        std::cout << "\n\033[1;30m[SERWER]:\033[0m " << res.dump() << "\n";
+                    if (res.next_before) std::cout << "Starsze: /history " << res.next_before << "\n";
+                }
+                else if (res.op == Op::SearchResult) {
+                    std::cout << "\n\033[1;36m--- WYNIKI WYSZUKIWANIA ---\033[0m\n";
+                    for (auto& m : res.messages) {
+                        std::cout << "#" << m.id << " [" << m.ts << "] " << m.from << " -> " << m.to << ": " << m.snippet << "\n";
                     }
-                } catch(...) {}
-                std::cout << "\033[1;37m>\033[0m " << std::flush;
-                read_header();
-            }
+                    if (res.messages.empty()) std::cout << "Brak wyników\n";
+                    if (res.next_offset) std::cout << "Dalej: /search +" << res.next_offset << " <słowa>\n";
+                }
+                else if (res.op == Op::Ok) {
+                    std::cout << "\n\033[1;32m[OK]:\033[0m " << (res.message.empty() ? "Operacja powiodła się" : res.message) << "\n";
+                }
+                else if (res.op == Op::Error) {
+                    std::cout << "\n\033[1;31m[BŁĄD]:\033[0m " << (res.message.empty() ? "Nieznany błąd" : res.message) << "\n";
+                }
+                else {
+                    std::cout << "\n\033[1;30m[SERWER]:\033[0m " << std::string(body_.begin(), body_.end()) << "\n";
+                }
+            } catch(...) {}
+            std::cout << "\033[1;37m>\033[0m " << std::flush;
+            read_header();
         });
     }
 
+    boost::asio::io_context& io_;
     ssl::context ssl_ctx_;
-    ssl::stream<tcp::socket> stream_;
+    std::optional<ssl::stream<tcp::socket>> stream_;
+    std::string host_, port_;
+    unsigned conn_ = 0; // numer połączenia; handlery starego strumienia są ignorowane
+    bool connected_ = false;
+    bool writing_ = false;
+    bool resumed_ = false;
+    std::optional<proto::Packet> login_;
     std::array<char, 4> header_{};
     std::vector<char> body_;
+    proto::Format format_ = proto::Format::Json;
+    std::deque<std::shared_ptr<std::string>> out_;
+    boost::asio::steady_timer ack_timer_;
+    boost::asio::steady_timer reconnect_timer_;
+    std::unique_ptr<SSL_SESSION, decltype(&SSL_SESSION_free)> session_;
+    bool ack_armed_ = false;
+    int64_t last_id_ = 0;
 };
 
 int main() {
@@ -122,7 +260,8 @@ int main() {
                   << "║ /send <u> <msg>    |  /stats           ║\n"
                   << "║ /create_group <g>  |  /join <g>        ║\n"
                   << "║ /send_group <g> <m>|  /members <g>     ║\n"
-                  << "║ /history           |  /quit            ║\n"
+                  << "║ /history [id]      |  /search <txt>    ║\n"
+                  << "║ /search +<n> <txt> |  /quit            ║\n"
                   << "╚════════════════════════════════════════╝\n\033[0m";
 
         std::string l;
@@ -130,24 +269,37 @@ int main() {
             if (l == "/quit") break;
             if (l.empty()) continue;
             std::istringstream iss(l); std::string cmd; iss >> cmd;
-            json j;
+            proto::Packet j;
             if (cmd == "/register" || cmd == "/login") {
                 std::string u, p; if(!(iss >> u >> p)) continue;
-                j["type"] = (cmd == "/register" ? "register" : "login");
-                j["username"] = u; j["password"] = p;
+                j.op = (cmd == "/register" ? Op::Register : Op::Login);
+                j.username = u; j.password = p;
             } else if (cmd == "/send") {
                 std::string to, m; iss >> to; std::getline(iss, m);
                 if(!m.empty() && m[0]==' ') m.erase(0,1);
-                j["type"] = "send"; j["to"] = to; j["message"] = m;
+                j.op = Op::Send; j.to = to; j.message = m;
             } else if (cmd == "/send_group") {
                 std::string g, m; iss >> g; std::getline(iss, m);
                 if(!m.empty() && m[0]==' ') m.erase(0,1);
-                j["type"] = "send_group"; j["group"] = g; j["message"] = m;
-            } else if (cmd == "/create_group") { std::string g; if(!(iss >> g)) continue; j["type"] = "create_group"; j["group"] = g; }
-            else if (cmd == "/join") { std::string g; if(!(iss >> g)) continue; j["type"] = "join_group"; j["group"] = g; }
-            else if (cmd == "/members") { std::string g; if(!(iss >> g)) continue; j["type"] = "group_members"; j["group"] = g; }
-            else if (cmd == "/stats") j["type"] = "stats";
-            else if (cmd == "/history") j["type"] = "history";
+                j.op = Op::SendGroup; j.group = g; j.message = m;
+            } else if (cmd == "/create_group") { std::string g; if(!(iss >> g)) continue; j.op = Op::CreateGroup; j.group = g; }
+            else if (cmd == "/join") { std::string g; if(!(iss >> g)) continue; j.op = Op::JoinGroup; j.group = g; }
+            else if (cmd == "/members") { std::string g; if(!(iss >> g)) continue; j.op = Op::GroupMembers; j.group = g; }
+            else if (cmd == "/stats") j.op = Op::Stats;
+            else if (cmd == "/history") { j.op = Op::History; iss >> j.before_id; }
+            else if (cmd == "/search") {
+                // "/search +20 słowa" - strona od 20. wyniku
+                std::string q; std::getline(iss, q);
+                std::size_t start = q.find_first_not_of(' ');
+                if (start == std::string::npos) continue;
+                q.erase(0, start);
+                if (q[0] == '+') {
+                    std::size_t end = q.find(' ');
+                    try { j.offset = static_cast<uint32_t>(std::stoul(q.substr(1, end == std::string::npos ? end : end - 1))); } catch (...) { continue; }
+                    q = end == std::string::npos ? "" : q.substr(end + 1);
+                }
+                j.op = Op::Search; j.query = q;
+            }
             else continue;
             c.send(j);
         }
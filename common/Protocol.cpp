@@ -0,0 +1,290 @@
+#include "Protocol.hpp"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+
+using json = nlohmann::json;
+
+namespace proto {
+
+namespace {
+
+struct OpName {
+    Op op;
+    const char* name;
+};
+
+// nazwy "type" w protokole JSON
+const OpName kOpNames[] = {
+    {Op::Register, "register"},
+    {Op::Login, "login"},
+    {Op::Send, "send"},
+    {Op::SendGroup, "send_group"},
+    {Op::GroupMembers, "group_members"},
+    {Op::Stats, "stats"},
+    {Op::CreateGroup, "create_group"},
+    {Op::JoinGroup, "join_group"},
+    {Op::History, "history"},
+    {Op::Ack, "ack"},
+    {Op::Pong, "pong"},
+    {Op::Search, "search"},
+    {Op::Ok, "ok"},
+    {Op::Error, "error"},
+    {Op::Message, "message"},
+    {Op::GroupMembersResult, "group_members"},
+    {Op::StatsResult, "stats"},
+    {Op::HistoryResult, "history"},
+    {Op::Ping, "ping"},
+    {Op::SearchResult, "search"},
+};
+
+bool is_response(Op op) { return static_cast<uint8_t>(op) >= 0x80; }
+
+// Ta sama nazwa bywa żądaniem i odpowiedzią (np. "history"), kierunek rozstrzyga.
+Op op_from_name(const std::string& name, bool response) {
+    for (const auto& o : kOpNames) {
+        if (name == o.name && is_response(o.op) == response) return o.op;
+    }
+    return Op::Unknown;
+}
+
+class Writer {
+public:
+    void u8(uint8_t v) { out_.push_back(static_cast<char>(v)); }
+    void u32(uint32_t v) {
+        char b[4] = {char(v >> 24), char(v >> 16), char(v >> 8), char(v)};
+        out_.append(b, 4);
+    }
+    void u64(uint64_t v) { u32(static_cast<uint32_t>(v >> 32)); u32(static_cast<uint32_t>(v)); }
+    void str(const std::string& s) { u32(static_cast<uint32_t>(s.size())); out_.append(s); }
+    void list(const std::vector<std::string>& v) { u32(static_cast<uint32_t>(v.size())); for (const auto& s : v) str(s); }
+    std::string take() { return std::move(out_); }
+
+private:
+    std::string out_;
+};
+
+class Reader {
+public:
+    Reader(const char* p, std::size_t n) : p_(p), end_(p + n) {}
+    uint8_t u8() { need(1); return static_cast<uint8_t>(*p_++); }
+    uint32_t u32() {
+        need(4);
+        auto b = reinterpret_cast<const unsigned char*>(p_);
+        p_ += 4;
+        return (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | uint32_t(b[3]);
+    }
+    uint64_t u64() { uint64_t hi = u32(); return (hi << 32) | u32(); }
+    std::string str() {
+        uint32_t n = u32();
+        need(n);
+        std::string s(p_, n);
+        p_ += n;
+        return s;
+    }
+    // każdy element zajmuje co najmniej min_item bajtów - chroni przed gigantycznym reserve
+    uint32_t count(std::size_t min_item) {
+        uint32_t n = u32();
+        if (static_cast<std::size_t>(end_ - p_) / min_item < n) throw DecodeError("list too long");
+        return n;
+    }
+    std::vector<std::string> list() {
+        std::vector<std::string> v(count(4));
+        for (auto& s : v) s = str();
+        return v;
+    }
+    void finish() const { if (p_ != end_) throw DecodeError("trailing bytes"); }
+
+private:
+    void need(std::size_t n) const { if (static_cast<std::size_t>(end_ - p_) < n) throw DecodeError("truncated packet"); }
+
+    const char* p_;
+    const char* end_;
+};
+
+std::string encode_binary(const Packet& p) {
+    Writer w;
+    w.u8(static_cast<uint8_t>(p.op));
+    switch (p.op) {
+    case Op::Register:
+    case Op::Login: w.str(p.username); w.str(p.password); break;
+    case Op::Send: w.str(p.to); w.str(p.message); break;
+    case Op::SendGroup: w.str(p.group); w.str(p.message); break;
+    case Op::GroupMembers:
+    case Op::CreateGroup:
+    case Op::JoinGroup: w.str(p.group); break;
+    case Op::Stats:
+    case Op::Pong:
+    case Op::Ping: break;
+    case Op::History: w.u64(static_cast<uint64_t>(p.before_id)); w.u32(p.limit); break;
+    case Op::Search: w.str(p.query); w.u32(p.offset); w.u32(p.limit); break;
+    case Op::Ack: w.u64(static_cast<uint64_t>(p.id)); break;
+    case Op::Ok:
+    case Op::Error: w.str(p.message); break;
+    case Op::Message: w.str(p.from); w.str(p.message); w.str(p.ts); w.u64(static_cast<uint64_t>(p.id)); break;
+    case Op::GroupMembersResult: w.str(p.group); w.list(p.members); break;
+    case Op::StatsResult: w.str(p.data); break;
+    case Op::HistoryResult:
+        w.u64(static_cast<uint64_t>(p.next_before));
+        w.u32(static_cast<uint32_t>(p.messages.size()));
+        for (const auto& m : p.messages) { w.u64(static_cast<uint64_t>(m.id)); w.str(m.from); w.str(m.to); w.str(m.message); w.str(m.ts); w.str(m.group); }
+        break;
+    case Op::SearchResult:
+        w.u32(p.next_offset);
+        w.u32(static_cast<uint32_t>(p.messages.size()));
+        for (const auto& m : p.messages) {
+            w.u64(static_cast<uint64_t>(m.id)); w.str(m.from); w.str(m.to); w.str(m.message); w.str(m.ts); w.str(m.group); w.str(m.snippet);
+        }
+        break;
+    case Op::Unknown: break;
+    }
+    return w.take();
+}
+
+Packet decode_binary(const char* data, std::size_t size, bool response) {
+    Reader r(data, size);
+    Packet p;
+    p.op = static_cast<Op>(r.u8());
+    switch (p.op) {
+    case Op::Register:
+    case Op::Login: p.username = r.str(); p.password = r.str(); break;
+    case Op::Send: p.to = r.str(); p.message = r.str(); break;
+    case Op::SendGroup: p.group = r.str(); p.message = r.str(); break;
+    case Op::GroupMembers:
+    case Op::CreateGroup:
+    case Op::JoinGroup: p.group = r.str(); break;
+    case Op::Stats:
+    case Op::Pong:
+    case Op::Ping: break;
+    case Op::History: p.before_id = static_cast<int64_t>(r.u64()); p.limit = r.u32(); break;
+    case Op::Search: p.query = r.str(); p.offset = r.u32(); p.limit = r.u32(); break;
+    case Op::Ack: p.id = static_cast<int64_t>(r.u64()); break;
+    case Op::Ok:
+    case Op::Error: p.message = r.str(); break;
+    case Op::Message: p.from = r.str(); p.message = r.str(); p.ts = r.str(); p.id = static_cast<int64_t>(r.u64()); break;
+    case Op::GroupMembersResult: p.group = r.str(); p.members = r.list(); break;
+    case Op::StatsResult: p.data = r.str(); break;
+    case Op::HistoryResult: {
+        p.next_before = static_cast<int64_t>(r.u64());
+        p.messages.resize(r.count(8 + 5 * 4));
+        for (auto& m : p.messages) { m.id = static_cast<int64_t>(r.u64()); m.from = r.str(); m.to = r.str(); m.message = r.str(); m.ts = r.str(); m.group = r.str(); }
+        break;
+    }
+    case Op::SearchResult: {
+        p.next_offset = r.u32();
+        p.messages.resize(r.count(8 + 6 * 4));
+        for (auto& m : p.messages) {
+            m.id = static_cast<int64_t>(r.u64()); m.from = r.str(); m.to = r.str(); m.message = r.str(); m.ts = r.str(); m.group = r.str(); m.snippet = r.str();
+        }
+        break;
+    }
+    default: throw DecodeError("unknown opcode");
+    }
+    if (is_response(p.op) != response) throw DecodeError("unexpected opcode");
+    r.finish();
+    return p;
+}
+
+// Puste pola są pomijane - stare klienty korzystają z json.value(..., domyślna).
+void put(json& j, const char* key, const std::string& v) { if (!v.empty()) j[key] = v; }
+
+std::string encode_json(const Packet& p) {
+    json j;
+    j["type"] = op_name(p.op);
+    put(j, "username", p.username);
+    put(j, "password", p.password);
+    put(j, "from", p.from);
+    put(j, "to", p.to);
+    put(j, "group", p.group);
+    put(j, "message", p.message);
+    put(j, "ts", p.ts);
+    put(j, "data", p.data);
+    put(j, "query", p.query);
+    if (p.id) j["id"] = p.id;
+    if (p.acks) j["acks"] = true;
+    if (p.op == Op::GroupMembersResult) j["members"] = p.members;
+    if (p.op == Op::History) {
+        if (p.before_id) j["before"] = p.before_id;
+        if (p.limit) j["limit"] = p.limit;
+    }
+    if (p.op == Op::Search) {
+        if (p.offset) j["offset"] = p.offset;
+        if (p.limit) j["limit"] = p.limit;
+    }
+    if (p.op == Op::HistoryResult) j["next_before"] = p.next_before;
+    if (p.op == Op::SearchResult) j["next_offset"] = p.next_offset;
+    if (p.op == Op::HistoryResult || p.op == Op::SearchResult) {
+        json arr = json::array();
+        for (const auto& m : p.messages) {
+            json row = {{"id", m.id}, {"from", m.from}, {"to", m.to}, {"message", m.message}, {"ts", m.ts}};
+            put(row, "group", m.group);
+            put(row, "snippet", m.snippet);
+            arr.push_back(row);
+        }
+        j["messages"] = arr;
+    }
+    return j.dump();
+}
+
+std::string str_field(const json& j, const char* key) {
+    auto it = j.find(key);
+    return it != j.end() && it->is_string() ? it->get<std::string>() : std::string();
+}
+
+int64_t int_field(const json& j, const char* key) {
+    auto it = j.find(key);
+    return it != j.end() && it->is_number_integer() ? it->get<int64_t>() : 0;
+}
+
+Packet decode_json(const char* data, std::size_t size, bool response) {
+    json j = json::parse(data, data + size, nullptr, false);
+    if (j.is_discarded() || !j.is_object()) throw DecodeError("invalid json");
+    Packet p;
+    p.op = op_from_name(str_field(j, "type"), response);
+    p.username = str_field(j, "username");
+    p.password = str_field(j, "password");
+    p.from = str_field(j, "from");
+    p.to = str_field(j, "to");
+    p.group = str_field(j, "group");
+    p.message = str_field(j, "message");
+    p.ts = str_field(j, "ts");
+    p.data = str_field(j, "data");
+    p.query = str_field(j, "query");
+    p.id = int_field(j, "id");
+    if (auto it = j.find("acks"); it != j.end() && it->is_boolean()) p.acks = it->get<bool>();
+    p.before_id = int_field(j, "before");
+    p.limit = static_cast<uint32_t>(std::clamp<int64_t>(int_field(j, "limit"), 0, UINT32_MAX));
+    p.next_before = int_field(j, "next_before");
+    p.offset = static_cast<uint32_t>(std::clamp<int64_t>(int_field(j, "offset"), 0, UINT32_MAX));
+    p.next_offset = static_cast<uint32_t>(std::clamp<int64_t>(int_field(j, "next_offset"), 0, UINT32_MAX));
+    if (auto it = j.find("members"); it != j.end() && it->is_array()) {
+        for (const auto& m : *it) if (m.is_string()) p.members.push_back(m.get<std::string>());
+    }
+    if (auto it = j.find("messages"); it != j.end() && it->is_array()) {
+        for (const auto& m : *it) {
+            if (!m.is_object()) continue;
+            p.messages.push_back({int_field(m, "id"), str_field(m, "from"), str_field(m, "to"), str_field(m, "message"), str_field(m, "ts"), str_field(m, "group"), str_field(m, "snippet")});
+        }
+    }
+    return p;
+}
+
+} // namespace
+
+const char* op_name(Op op) {
+    for (const auto& o : kOpNames) if (o.op == op) return o.name;
+    return "";
+}
+
+std::string encode(const Packet& p, Format fmt) {
+    return fmt == Format::Binary ? encode_binary(p) : encode_json(p);
+}
+
+Packet decode_request(const char* data, std::size_t size, Format fmt) {
+    return fmt == Format::Binary ? decode_binary(data, size, false) : decode_json(data, size, false);
+}
+
+Packet decode_response(const char* data, std::size_t size, Format fmt) {
+    return fmt == Format::Binary ? decode_binary(data, size, true) : decode_json(data, size, true);
+}
+
+} // namespace proto
@@ -0,0 +1,103 @@
+#pragma once
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Wspólny kodek klienta i serwera. Na drucie zawsze: 4 bajty długości (big endian)
+// + treść. Treść to JSON (stare klienty) albo format binarny wybierany przez
+// ALPN "chat-bin/1" przy handshake'u TLS:
+//   [1 bajt opcode][pola w stałej kolejności dla danego opcode]
+//   tekst = u32 długość + bajty, lista = u32 liczba elementów + elementy,
+//   id wiadomości = u64.
+namespace proto {
+
+inline constexpr const char* kBinaryAlpn = "chat-bin/1";
+// ALPN w formacie TLS: bajt długości + nazwa
+inline constexpr unsigned char kAlpnWire[] = {10, 'c', 'h', 'a', 't', '-', 'b', 'i', 'n', '/', '1'};
+
+enum class Format { Json, Binary };
+
+enum class Op : uint8_t {
+    Unknown = 0,
+    // klient -> serwer
+    Register = 1,
+    Login = 2,
+    Send = 3,
+    SendGroup = 4,
+    GroupMembers = 5,
+    Stats = 6,
+    CreateGroup = 7,
+    JoinGroup = 8,
+    History = 9,
+    Ack = 10, // bez odpowiedzi
+    Pong = 11, // odpowiedź na Ping serwera, bez odpowiedzi
+    Search = 12,
+    // serwer -> klient
+    Ok = 0x80,
+    Error = 0x81,
+    Message = 0x82,
+    GroupMembersResult = 0x83,
+    StatsResult = 0x84,
+    HistoryResult = 0x85,
+    Ping = 0x86, // heartbeat: serwer pyta, czy klient żyje
+    SearchResult = 0x87,
+};
+
+struct HistoryEntry {
+    int64_t id = 0;
+    std::string from;
+    std::string to;
+    std::string message;
+    std::string ts;
+    std::string group;
+    std::string snippet; // tylko w wynikach wyszukiwania: fragment z trafieniami w [ ]
+};
+
+// Jeden typ na wszystkie komunikaty; dany opcode używa tylko części pól.
+struct Packet {
+    Op op = Op::Unknown;
+    std::string username;
+    std::string password;
+    std::string from;
+    std::string to;
+    std::string group;
+    std::string message;
+    std::string ts;
+    std::string data;
+    // id wiadomości: w Message (do potwierdzenia) i w Ack - id ostatnio odebranej,
+    // co potwierdza ją i wszystkie ramki przed nią (nie wszystkie mniejsze id)
+    int64_t id = 0;
+    // Login: klient potwierdza wiadomości przez Ack i odpowiada na Ping. W binarnym
+    // zawsze (nie ma tego na drucie), w JSON tylko gdy wysłał "acks": true - starsze
+    // klienty JSON nie znają ani Ack, ani Ping: serwer oznacza u nich dostarczenie
+    // po zapisie ramki i nie zamyka ich za ciszę.
+    bool acks = false;
+    std::vector<std::string> members;
+    std::vector<HistoryEntry> messages;
+    // stronicowanie historii: żądanie niesie kursor i rozmiar strony (0 = domyślne),
+    // odpowiedź kursor następnej strony (0 = brak starszych)
+    int64_t before_id = 0;
+    uint32_t limit = 0;
+    int64_t next_before = 0;
+    // wyszukiwanie: słowa (ostatnie z * = prefiks), strona od offset w kolejności trafności;
+    // odpowiedź niesie offset następnej strony (0 = koniec)
+    std::string query;
+    uint32_t offset = 0;
+    uint32_t next_offset = 0;
+};
+
+struct DecodeError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// nazwa "type" z protokołu JSON ("" dla nieznanego)
+const char* op_name(Op op);
+
+std::string encode(const Packet& p, Format fmt);
+// Rzucają DecodeError. W JSON nazwy typów żądań i odpowiedzi się pokrywają
+// ("history", "stats"), więc kierunek podaje wywołujący.
+Packet decode_request(const char* data, std::size_t size, Format fmt);
+Packet decode_response(const char* data, std::size_t size, Format fmt);
+
+} // namespace proto
@@ -0,0 +1,82 @@
+#include "Config.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+ServerConfig parse_args(int argc, char** argv) {
+    ServerConfig cfg;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--check-plans") { cfg.check_plans = true; continue; }
+        if (arg == "--rebuild-stats") { cfg.rebuild_stats = true; continue; }
+        if (arg == "--ktls") { cfg.ktls = true; continue; }
+        if (i + 1 >= argc) throw std::invalid_argument("missing value for " + arg);
+        std::string val = argv[++i];
+        if (arg == "--port") cfg.port = static_cast<unsigned short>(std::stoul(val));
+        else if (arg == "--db") cfg.db_path = val;
+        else if (arg == "--shards") cfg.db_shards = std::stoul(val);
+        else if (arg == "--db-readers") cfg.db.readers = std::stoul(val);
+        else if (arg == "--db-synchronous") cfg.db.synchronous = val;
+        else if (arg == "--db-cache-kib") cfg.db.cache_size_kib = std::stoi(val);
+        else if (arg == "--db-mmap") cfg.db.mmap_size = std::stoll(val);
+        else if (arg == "--cache-users") cfg.db.cache_users = std::stoul(val);
+        else if (arg == "--cache-groups") cfg.db.cache_groups = std::stoul(val);
+        else if (arg == "--threads") cfg.io_threads = std::stoul(val);
+        else if (arg == "--hash-threads") cfg.hash_threads = std::stoul(val);
+        else if (arg == "--hash-queue") cfg.hash_queue = std::stoul(val);
+        else if (arg == "--pbkdf2-iterations") cfg.pbkdf2_iterations = std::stoi(val);
+        else if (arg == "--db-read-queue") cfg.db_read_queue = std::stoul(val);
+        else if (arg == "--db-batch") cfg.db_batch = std::stoul(val);
+        else if (arg == "--handshake-timeout") cfg.handshake_timeout_s = static_cast<unsigned>(std::stoul(val));
+        else if (arg == "--idle-timeout") cfg.idle_timeout_s = static_cast<unsigned>(std::stoul(val));
+        else if (arg == "--heartbeat") cfg.heartbeat_s = static_cast<unsigned>(std::stoul(val));
+        else if (arg == "--rate-user") cfg.rate_user = std::stod(val);
+        else if (arg == "--rate-user-burst") cfg.rate_user_burst = std::stod(val);
+        else if (arg == "--rate-ip") cfg.rate_ip = std::stod(val);
+        else if (arg == "--rate-ip-burst") cfg.rate_ip_burst = std::stod(val);
+        else if (arg == "--rate-auth") cfg.rate_auth = std::stod(val);
+        else if (arg == "--rate-auth-burst") cfg.rate_auth_burst = std::stod(val);
+        else if (arg == "--rate-limit-strikes") cfg.rate_limit_strikes = std::stoul(val);
+        else if (arg == "--max-frame") cfg.max_frame_bytes = std::stoul(val);
+        else if (arg == "--buffer-pool-keep") cfg.buffer_pool_keep = std::stoul(val);
+        else if (arg == "--max-outbox") cfg.max_outbox_bytes = std::stoul(val);
+        else if (arg == "--db-linger-us") cfg.db_linger_us = static_cast<unsigned>(std::stoul(val));
+        else if (arg == "--admin-port") cfg.admin_port = static_cast<unsigned short>(std::stoul(val));
+        else if (arg == "--admin-bind") cfg.admin_bind = val;
+        else if (arg == "--tls-min") cfg.tls_min_version = val;
+        else if (arg == "--tls-ciphersuites") cfg.tls_ciphersuites = val;
+        else if (arg == "--tls-ciphers") cfg.tls_ciphers = val;
+        else if (arg == "--tls-groups") cfg.tls_groups = val;
+        else if (arg == "--tls-resumption") cfg.tls_resumption = val;
+        else if (arg == "--tls-session-cache") cfg.tls_session_cache = std::stol(val);
+        else if (arg == "--tls-session-timeout") cfg.tls_session_timeout = std::stol(val);
+        else if (arg == "--backlog-chunk") cfg.backlog_chunk = std::stoul(val);
+        else if (arg == "--history-page") cfg.history_page = std::stoul(val);
+        else if (arg == "--history-page-max") cfg.history_page_max = std::stoul(val);
+        else if (arg == "--search-page") cfg.search_page = std::stoul(val);
+        else if (arg == "--search-page-max") cfg.search_page_max = std::stoul(val);
+        else if (arg == "--search-max-offset") cfg.search_max_offset = std::stoul(val);
+        else throw std::invalid_argument("unknown option " + arg);
+    }
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    if (cfg.io_threads == 0) cfg.io_threads = cores;
+    if (cfg.hash_threads == 0) cfg.hash_threads = std::max(1u, cores / 2);
+    if (cfg.db_shards < 1) throw std::invalid_argument("--shards must be positive");
+    if (cfg.pbkdf2_iterations < 1) throw std::invalid_argument("--pbkdf2-iterations must be positive");
+    if (cfg.handshake_timeout_s < 1) throw std::invalid_argument("--handshake-timeout must be positive");
+    if (cfg.idle_timeout_s && cfg.heartbeat_s >= cfg.idle_timeout_s) throw std::invalid_argument("--heartbeat must be shorter than --idle-timeout");
+    for (double r : {cfg.rate_user, cfg.rate_user_burst, cfg.rate_ip, cfg.rate_ip_burst, cfg.rate_auth, cfg.rate_auth_burst})
+        if (!(r >= 0)) throw std::invalid_argument("rate limits must be non-negative");
+    if (cfg.max_frame_bytes < 1) throw std::invalid_argument("--max-frame must be positive");
+    if (cfg.db_read_queue < 1) throw std::invalid_argument("--db-read-queue must be positive");
+    if (cfg.backlog_chunk < 1) throw std::invalid_argument("--backlog-chunk must be positive");
+    if (cfg.history_page_max < 1) throw std::invalid_argument("--history-page-max must be positive");
+    if (cfg.search_page_max < 1) throw std::invalid_argument("--search-page-max must be positive");
+    if (cfg.tls_min_version != "1.2" && cfg.tls_min_version != "1.3") throw std::invalid_argument("--tls-min must be 1.2 or 1.3");
+    if (cfg.tls_resumption != "tickets" && cfg.tls_resumption != "cache" && cfg.tls_resumption != "off")
+        throw std::invalid_argument("--tls-resumption must be tickets, cache or off");
+    if (cfg.tls_session_timeout < 1) throw std::invalid_argument("--tls-session-timeout must be positive");
+    cfg.history_page = std::clamp<std::size_t>(cfg.history_page, 1, cfg.history_page_max);
+    cfg.search_page = std::clamp<std::size_t>(cfg.search_page, 1, cfg.search_page_max);
+    return cfg;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+#include "db/Database.hpp"
+
+struct ServerConfig {
+    unsigned short port = 5555;
+    std::string db_path = "chat.db";
+    DatabaseOptions db;
+    std::size_t db_shards = 1; // >1: katalog w db_path + pliki wiadomości chat.shardN.db
+    std::size_t io_threads = 0; // 0 = liczba rdzeni
+    std::size_t hash_threads = 0; // 0 = połowa rdzeni
+    std::size_t hash_queue = 64;  // powyżej tej kolejki register/login dostają "server busy"
+    int pbkdf2_iterations = 120000;
+    std::size_t db_batch = 256;      // maks. zapisów w jednej transakcji
+    unsigned db_linger_us = 2000;    // ile partia czeka na kolejne zapisy
+    std::size_t db_read_queue = 1024; // odczyty czekające na pulę (wątków tyle, co db.readers)
+    std::size_t max_outbox_bytes = 4 * 1024 * 1024; // powyżej sesja jest rozłączana
+    unsigned handshake_timeout_s = 10; // niedokończony handshake TLS
+    unsigned idle_timeout_s = 90;      // bez żadnej ramki od klienta z heartbeat (starsze JSON: keepalive TCP); 0 = bez limitu
+    unsigned heartbeat_s = 30;         // Ping po tylu sekundach ciszy; 0 = wyłączony
+    // token bucket: żądań na sekundę i zapas; 0 = bez limitu
+    double rate_user = 20, rate_user_burst = 40; // na zalogowanego użytkownika
+    double rate_ip = 0, rate_ip_burst = 200;     // na adres (domyślnie wyłączony: NAT, proxy)
+    double rate_auth = 5, rate_auth_burst = 20;  // login/register na adres
+    std::size_t rate_limit_strikes = 50; // tyle odrzuconych z rzędu -> rozłączenie; 0 = nigdy
+    std::size_t max_frame_bytes = 64 * 1024;  // większa ramka od klienta -> błąd i rozłączenie
+    std::size_t buffer_pool_keep = 256;       // wolne bufory trzymane w każdej klasie rozmiaru
+    std::size_t backlog_chunk = 256;   // zaległe wiadomości po logowaniu, porcja z bazy
+    std::size_t history_page = 20;     // domyślny rozmiar strony historii
+    std::size_t history_page_max = 100; // większe żądania są przycinane
+    std::size_t search_page = 20;      // domyślny rozmiar strony wyszukiwania
+    std::size_t search_page_max = 50;
+    std::size_t search_max_offset = 500; // głębsze strony -> błąd (każda liczy wszystkie poprzednie)
+    unsigned short admin_port = 9555;     // GET /metrics (Prometheus); 0 = wyłączone
+    std::string admin_bind = "127.0.0.1"; // tylko lokalnie, bez uwierzytelniania
+    std::string tls_min_version = "1.2";  // "1.2" albo "1.3"; wynegocjowana jest zawsze najwyższa wspólna
+    std::string tls_ciphersuites = "TLS_AES_128_GCM_SHA256:TLS_CHACHA20_POLY1305_SHA256:TLS_AES_256_GCM_SHA384"; // TLS 1.3
+    std::string tls_ciphers = "ECDHE+AES128+AESGCM:ECDHE+CHACHA20:ECDHE+AES256+AESGCM"; // TLS 1.2
+    std::string tls_groups = "X25519:P-256";
+    std::string tls_resumption = "tickets"; // tickets | cache (sesje w pamięci serwera) | off
+    long tls_session_cache = 20480;         // wpisy cache sesji (tryb cache)
+    long tls_session_timeout = 7200;        // ważność biletu/sesji w sekundach
+    bool ktls = false;                      // szyfrowanie rekordów w jądrze (Linux, TLS 1.3)
+    bool check_plans = false;
+    bool rebuild_stats = false;
+};
+
+// Opcje w postaci "--nazwa wartość"; nieznana opcja -> std::invalid_argument.
+ServerConfig parse_args(int argc, char** argv);
@@ -0,0 +1,40 @@
+#include "PasswordHasher.hpp"
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+static std::vector<unsigned char> random_bytes(std::size_t n) {
+    std::vector<unsigned char> out(n);
+    RAND_bytes(out.data(), static_cast<int>(out.size()));
+    return out;
+}
+
+static std::vector<unsigned char> pbkdf2_sha256(const std::string& password, const std::vector<unsigned char>& salt, int iterations, std::size_t dk_len = 32) {
+    std::vector<unsigned char> out(dk_len);
+    PKCS5_PBKDF2_HMAC(password.c_str(), static_cast<int>(password.size()), salt.data(), static_cast<int>(salt.size()), iterations, EVP_sha256(), static_cast<int>(dk_len), out.data());
+    return out;
+}
+
+static bool constant_time_equal(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b) {
+    if (a.size() != b.size()) return false;
+    return CRYPTO_memcmp(a.data(), b.data(), a.size()) == 0;
+}
+
+PasswordHasher::PasswordHasher(std::size_t threads, std::size_t max_queue, int iterations)
+    : iterations_(iterations), pool_(threads, max_queue) {}
+
+bool PasswordHasher::hash(std::string password, HashCallback done) {
+    return pool_.try_submit([this, password = std::move(password), done = std::move(done)]() {
+        auto salt = random_bytes(16);
+        auto hash = pbkdf2_sha256(password, salt, iterations_);
+        done(std::move(salt), std::move(hash));
+    });
+}
+
+bool PasswordHasher::verify(std::string password, std::vector<unsigned char> salt, std::vector<unsigned char> expected,
+                            int iterations, VerifyCallback done) {
+    return pool_.try_submit([password = std::move(password), salt = std::move(salt), expected = std::move(expected),
+                             iterations, done = std::move(done)]() {
+        done(constant_time_equal(pbkdf2_sha256(password, salt, iterations), expected));
+    });
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../util/WorkerPool.hpp"
+
+// PBKDF2-SHA256 liczone na osobnej puli, żeby logowania nie blokowały wątków I/O.
+// Callbacki wołane są z wątku puli - wywołujący sam wraca na swój strand.
+// Metody zwracają false, gdy kolejka jest pełna (serwer zajęty).
+class PasswordHasher {
+public:
+    using HashCallback = std::function<void(std::vector<unsigned char> salt, std::vector<unsigned char> hash)>;
+    using VerifyCallback = std::function<void(bool ok)>;
+
+    PasswordHasher(std::size_t threads, std::size_t max_queue, int iterations);
+
+    int iterations() const { return iterations_; }
+    std::size_t queue_depth() const { return pool_.queue_depth(); }
+
+    bool hash(std::string password, HashCallback done);
+    bool verify(std::string password, std::vector<unsigned char> salt, std::vector<unsigned char> expected,
+                int iterations, VerifyCallback done);
+
+private:
+    int iterations_;
+    WorkerPool pool_;
+};
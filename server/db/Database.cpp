@@ -1,199 +1,616 @@
 #include "Database.hpp"
+#include "Migrations.hpp"
 #include <stdexcept>
 #include <algorithm>
+#include <limits>
 
-Database::Database(const std::string& path) : db_(nullptr) {
-    if (sqlite3_open(path.c_str(), &db_) != SQLITE_OK) {
+static SqliteHandle open_connection(const std::string& path, int flags, const DatabaseOptions& opts) {
+    sqlite3* raw = nullptr;
+    int rc = sqlite3_open_v2(path.c_str(), &raw, flags, nullptr);
+    SqliteHandle db(raw);
+    if (rc != SQLITE_OK) {
         throw std::runtime_error("cannot open database");
     }
+    sqlite3_busy_timeout(db.get(), opts.busy_timeout_ms);
+    std::string pragmas =
+        "PRAGMA foreign_keys = " + std::string(opts.foreign_keys ? "ON" : "OFF") + ";"
+        "PRAGMA cache_size = -" + std::to_string(opts.cache_size_kib) + ";"
+        "PRAGMA mmap_size = " + std::to_string(opts.mmap_size) + ";";
+    sqlite3_exec(db.get(), pragmas.c_str(), nullptr, nullptr, nullptr);
+    return db;
+}
+
+Database::Database(const std::string& path, const DatabaseOptions& opts)
+    : users_(opts.cache_users), group_members_(opts.cache_groups), group_ids_(opts.cache_groups) {
+    static const char* sync_modes[] = {"OFF", "NORMAL", "FULL", "EXTRA"};
+    if (std::find(std::begin(sync_modes), std::end(sync_modes), opts.synchronous) == std::end(sync_modes)) {
+        throw std::invalid_argument("invalid synchronous mode: " + opts.synchronous);
+    }
+
+    db_ = open_connection(path, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, opts);
+    // journal_mode jest zapisywany w pliku bazy, synchronous dotyczy tylko tego połączenia
+    std::string wal = "PRAGMA journal_mode = WAL; PRAGMA synchronous = " + opts.synchronous + ";";
+    sqlite3_exec(db_.get(), wal.c_str(), nullptr, nullptr, nullptr);
+    run_migrations(db_.get());
+
+    sqlite3* db = db_.get();
+    insert_user_ = Statement(db, "INSERT INTO users (username, salt, hash, iterations) VALUES (?, ?, ?, ?);");
+    insert_message_ = Statement(db, "INSERT INTO messages (id, sender, receiver, content) VALUES (?, ?, ?, ?);");
+    insert_group_message_ = Statement(db,
+        "INSERT INTO messages (sender, receiver, content, group_id, delivered) "
+        "SELECT ?1, name, ?3, id, 1 FROM groups WHERE name = ?2;");
+    insert_group_deliveries_ = Statement(db,
+        "INSERT INTO message_deliveries (message_id, receiver) "
+        "SELECT DISTINCT ?1, u.username FROM group_members gm JOIN users u ON u.id = gm.user_id "
+        "WHERE gm.group_id = (SELECT group_id FROM messages WHERE id = ?1) AND u.username <> ?2;");
+    insert_group_row_ = Statement(db,
+        "INSERT INTO messages (id, sender, receiver, content, group_id, delivered, is_copy) VALUES (?, ?, ?, ?, ?, 1, ?);");
+    insert_delivery_ = Statement(db, "INSERT OR IGNORE INTO message_deliveries (message_id, receiver) VALUES (?, ?);");
+    insert_group_ = Statement(db, "INSERT INTO groups (name) VALUES (?);");
+    insert_group_member_ = Statement(db,
+        "INSERT INTO group_members (group_id, user_id) "
+        "SELECT g.id, u.id FROM groups g, users u "
+        "WHERE g.name = ? AND u.username = ?;");
+    insert_group_member_ids_ = Statement(db, "INSERT INTO group_members (group_id, user_id) VALUES (?, ?);");
+    select_group_id_ = Statement(db, "SELECT id FROM groups WHERE name = ?;");
+    update_delivered_ = Statement(db, "UPDATE messages SET delivered = 1 WHERE receiver = ?1 AND delivered = 0 AND id <= ?2;");
+    update_group_delivered_ = Statement(db,
+        "UPDATE message_deliveries SET delivered = 1 WHERE receiver = ?1 AND delivered = 0 AND message_id <= ?2;");
+    update_delivered_id_ = Statement(db, "UPDATE messages SET delivered = 1 WHERE id = ?2 AND receiver = ?1 AND delivered = 0;");
+    update_group_delivered_id_ = Statement(db,
+        "UPDATE message_deliveries SET delivered = 1 WHERE receiver = ?1 AND message_id = ?2 AND delivered = 0;");
+    begin_ = Statement(db, "BEGIN IMMEDIATE;");
+    commit_ = Statement(db, "COMMIT;");
+    rollback_ = Statement(db, "ROLLBACK;");
+    savepoint_ = Statement(db, "SAVEPOINT op;");
+    release_ = Statement(db, "RELEASE op;");
+    rollback_to_ = Statement(db, "ROLLBACK TO op;");
+
+    for (std::size_t i = 0; i < std::max<std::size_t>(1, opts.readers); ++i) {
+        auto r = std::make_unique<Reader>();
+        r->db = open_connection(path, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, opts);
+        sqlite3* rdb = r->db.get();
+        r->select_user = Statement(rdb, "SELECT id, salt, hash, iterations FROM users WHERE username = ?;");
+        // OR po kolumnach wymusza skan; osobne gałęzie po indeksach: wysłane, bezpośrednio
+        // odebrane i grupowe (przez message_deliveries). Keyset po id: każda gałąź
+        // zaczyna od id < ?3 i czyta najwyżej limit wierszy, więc głęboka strona
+        // kosztuje tyle co najnowsza.
+        r->select_history = Statement(rdb,
+            "SELECT * FROM "
+            "(SELECT id, sender, receiver, content, ts, group_id IS NOT NULL FROM messages "
+            "WHERE sender = ?1 AND is_copy = 0 AND id < ?3 ORDER BY id DESC LIMIT ?2) "
+            "UNION ALL "
+            "SELECT * FROM "
+            "(SELECT id, sender, receiver, content, ts, 0 FROM messages "
+            "WHERE receiver = ?1 AND group_id IS NULL AND id < ?3 ORDER BY id DESC LIMIT ?2) "
+            "UNION ALL "
+            "SELECT * FROM "
+            "(SELECT m.id, m.sender, m.receiver, m.content, m.ts, 1 FROM message_deliveries d JOIN messages m ON m.id = d.message_id "
+            "WHERE d.receiver = ?1 AND d.message_id < ?3 ORDER BY d.message_id DESC LIMIT ?2) "
+            "ORDER BY 1 DESC LIMIT ?2;");
+        r->select_sent = Statement(rdb,
+            "SELECT id, sender, receiver, content, ts, group_id IS NOT NULL FROM messages "
+            "WHERE sender = ?1 AND is_copy = 0 AND id < ?3 ORDER BY id DESC LIMIT ?2;");
+        // zaległe porcjami po id > ?2, obie gałęzie czytają najwyżej ?3 wierszy
+        r->select_undelivered = Statement(rdb,
+            "SELECT * FROM "
+            "(SELECT id, sender, receiver, content, ts, 0 FROM messages "
+            "WHERE receiver = ?1 AND delivered = 0 AND id > ?2 ORDER BY id LIMIT ?3) "
+            "UNION ALL "
+            "SELECT * FROM "
+            "(SELECT m.id, m.sender, m.receiver, m.content, m.ts, 1 FROM message_deliveries d JOIN messages m ON m.id = d.message_id "
+            "WHERE d.receiver = ?1 AND d.delivered = 0 AND d.message_id > ?2 ORDER BY d.message_id LIMIT ?3) "
+            "ORDER BY 1 LIMIT ?3;");
+        r->select_stats = Statement(rdb,
+            "SELECT s.sent_count, s.received_count, s.group_count, s.last_sent "
+            "FROM users u LEFT JOIN user_stats s ON s.username = u.username WHERE u.username = ?;");
+        r->select_user_stats = Statement(rdb,
+            "SELECT sent_count, received_count, group_count, last_sent FROM user_stats WHERE username = ?;");
+        r->select_group_id = Statement(rdb, "SELECT id FROM groups WHERE name = ?;");
+        r->select_group_members = Statement(rdb, "SELECT u.username FROM users u JOIN group_members gm ON u.id = gm.user_id JOIN groups g ON g.id = gm.group_id WHERE g.name = ?;");
+        r->select_user_groups = Statement(rdb,
+            "SELECT DISTINCT g.name FROM users u JOIN group_members gm ON gm.user_id = u.id JOIN groups g ON g.id = gm.group_id WHERE u.username = ?;");
+        // ?2 to wyrażenie MATCH z fts_match(): owner zawęża do rozmów user już w indeksie,
+        // warunek na messages odsiewa resztę (kopie, grupowe sprzed dołączenia).
+        r->select_search = Statement(rdb,
+            "SELECT m.id, m.sender, m.receiver, m.content, m.ts, m.group_id IS NOT NULL, "
+            "snippet(messages_fts, 0, '[', ']', '...', 12), bm25(messages_fts, 1.0, 0.0) AS score "
+            "FROM messages_fts JOIN messages m ON m.id = messages_fts.rowid "
+            "WHERE messages_fts MATCH ?2 AND ((m.sender = ?1 AND m.is_copy = 0) "
+            "OR (m.receiver = ?1 AND m.group_id IS NULL) "
+            "OR (m.group_id IS NOT NULL AND EXISTS (SELECT 1 FROM message_deliveries d WHERE d.receiver = ?1 AND d.message_id = m.id))) "
+            "ORDER BY score, m.id DESC LIMIT ?3 OFFSET ?4;");
+        free_readers_.push_back(r.get());
+        readers_.push_back(std::move(r));
+    }
+}
+
+// Wypożyczone połączenie do odczytu, oddawane do puli w destruktorze.
+class Database::ReadLease {
+public:
+    explicit ReadLease(Database& db) : db_(db), reader_(db.acquire_reader()) {}
+    ~ReadLease() { db_.release_reader(reader_); }
+    ReadLease(const ReadLease&) = delete;
+    ReadLease& operator=(const ReadLease&) = delete;
+    Reader* operator->() const { return reader_; }
+
+private:
+    Database& db_;
+    Reader* reader_;
+};
+
+Database::Reader* Database::acquire_reader() {
+    std::unique_lock<std::mutex> lock(readers_mu_);
+    readers_cv_.wait(lock, [this]() { return !free_readers_.empty(); });
+    Reader* r = free_readers_.back();
+    free_readers_.pop_back();
+    return r;
+}
+
+void Database::release_reader(Reader* reader) {
+    {
+        std::lock_guard<std::mutex> lock(readers_mu_);
+        free_readers_.push_back(reader);
+    }
+    readers_cv_.notify_one();
+}
+
+Database::~Database() = default;
+
+const char* DbMetrics::name(Method m) {
+    static const char* names[Count] = {
+        "create_user", "get_user", "save_message", "save_group_message", "get_history", "get_undelivered",
+        "mark_delivered", "get_stats", "create_group", "add_to_group", "get_group_members", "get_group",
+        "get_user_groups", "search", "commit"};
+    return names[m];
+}
+
+std::vector<std::string> Database::check_query_plans() {
+    std::vector<std::string> queries;
+    ReadLease r(*this);
+    for (Statement* s : {&r->select_user, &r->select_history, &r->select_sent, &r->select_undelivered,
+                         &r->select_stats, &r->select_user_stats, &r->select_group_members, &r->select_group_id,
+                         &r->select_user_groups, &r->select_search}) {
+        queries.push_back(sqlite3_sql(s->get()));
+    }
+    std::lock_guard<std::mutex> lock(mu_);
+    for (Statement* s : {&update_delivered_, &update_group_delivered_, &update_delivered_id_, &update_group_delivered_id_,
+                         &insert_group_member_, &insert_group_message_, &insert_group_deliveries_}) {
+        queries.push_back(sqlite3_sql(s->get()));
+    }
+    return find_table_scans(db_.get(), queries);
+}
 
-    const char* sql = 
-        "PRAGMA foreign_keys = ON;"
-        "CREATE TABLE IF NOT EXISTS users ("
-        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "username TEXT UNIQUE NOT NULL,"
-        "salt BLOB NOT NULL,"
-        "hash BLOB NOT NULL"
-        ");"
-        "CREATE TABLE IF NOT EXISTS messages ("
-        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "sender TEXT NOT NULL,"
-        "receiver TEXT NOT NULL,"
-        "content TEXT NOT NULL,"
-        "ts DATETIME DEFAULT CURRENT_TIMESTAMP,"
-        "delivered INTEGER DEFAULT 0"
-        ");"
-        "CREATE TABLE IF NOT EXISTS groups ("
-        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "name TEXT UNIQUE NOT NULL"
-        ");"
-        "CREATE TABLE IF NOT EXISTS group_members ("
-        "group_id INTEGER, user_id INTEGER,"
-        "FOREIGN KEY(group_id) REFERENCES groups(id), "
-        "FOREIGN KEY(user_id) REFERENCES users(id)"
-        ");"
-        "CREATE VIEW IF NOT EXISTS v_user_stats AS "
-        "SELECT u.username, "
-        "(SELECT COUNT(*) FROM messages WHERE sender = u.username) as sent_count, "
-        "(SELECT MAX(ts) FROM messages WHERE sender = u.username) as last_sent "
-        "FROM users u;"
-        "CREATE TRIGGER IF NOT EXISTS trg_prevent_self_msg "
-        "BEFORE INSERT ON messages "
-        "WHEN NEW.sender = NEW.receiver "
-        "BEGIN "
-        "SELECT RAISE(ABORT, 'Cannot send message to yourself'); "
-        "END;";
-
-    sqlite3_exec(db_, sql, nullptr, nullptr, nullptr);
-}
-
-Database::~Database() {
-    if (db_) sqlite3_close(db_);
+static MessageRecord read_message(const StatementScope& q) {
+    MessageRecord m;
+    m.id = q.int64(0);
+    m.from = q.text(1);
+    m.to = q.text(2);
+    m.content = q.text(3);
+    m.ts = q.text(4);
+    if (q.integer(5)) m.group = m.to;
+    return m;
 }
 
 bool Database::create_user(const std::string& username,
                            const std::vector<unsigned char>& salt,
-                           const std::vector<unsigned char>& hash) {
-    const char* sql = "INSERT INTO users (username, salt, hash) VALUES (?, ?, ?);";
-    sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) return false;
-    sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_blob(stmt, 2, salt.data(), (int)salt.size(), SQLITE_TRANSIENT);
-    sqlite3_bind_blob(stmt, 3, hash.data(), (int)hash.size(), SQLITE_TRANSIENT);
-    bool ok = (sqlite3_step(stmt) == SQLITE_DONE);
-    sqlite3_finalize(stmt);
+                           const std::vector<unsigned char>& hash,
+                           int iterations) {
+    ScopedTimer timer(metrics_.latency[DbMetrics::CreateUser]);
+    std::lock_guard<std::mutex> lock(mu_);
+    StatementScope q(insert_user_);
+    q.bind(1, username);
+    q.bind(2, salt);
+    q.bind(3, hash);
+    q.bind(4, iterations);
+    bool ok = q.step() == SQLITE_DONE;
+    invalidate_user(username);
     return ok;
 }
 
-bool Database::save_message(const std::string& from, const std::string& to, const std::string& content) {
-    const char* sql = "INSERT INTO messages (sender, receiver, content) VALUES (?, ?, ?);";
-    sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) return false;
-    sqlite3_bind_text(stmt, 1, from.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 2, to.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 3, content.c_str(), -1, SQLITE_TRANSIENT);
-    int rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    return (rc == SQLITE_DONE);
+sqlite3_int64 Database::save_message(const std::string& from, const std::string& to, const std::string& content) {
+    ScopedTimer timer(metrics_.latency[DbMetrics::SaveMessage]);
+    std::lock_guard<std::mutex> lock(mu_);
+    StatementScope q(insert_message_);
+    if (ids_) q.bind(1, ids_->fetch_add(1));
+    q.bind(2, from);
+    q.bind(3, to);
+    q.bind(4, content);
+    return q.step() == SQLITE_DONE ? sqlite3_last_insert_rowid(db_.get()) : 0;
+}
+
+sqlite3_int64 Database::save_group_message(const std::string& from, const std::string& group, const std::string& content) {
+    ScopedTimer timer(metrics_.latency[DbMetrics::SaveGroupMessage]);
+    std::lock_guard<std::mutex> lock(mu_);
+    // oba inserty razem albo wcale, niezależnie od reszty partii DbExecutora
+    { StatementScope sp(savepoint_); if (sp.step() != SQLITE_DONE) return 0; }
+    bool ok = false;
+    sqlite3_int64 id = 0;
+    {
+        StatementScope q(insert_group_message_);
+        q.bind(1, from);
+        q.bind(2, group);
+        q.bind(3, content);
+        ok = q.step() == SQLITE_DONE && sqlite3_changes(db_.get()) == 1;
+    }
+    if (ok) {
+        id = sqlite3_last_insert_rowid(db_.get());
+        StatementScope q(insert_group_deliveries_);
+        q.bind(1, id);
+        q.bind(2, from);
+        ok = q.step() == SQLITE_DONE;
+    }
+    if (!ok) { StatementScope rb(rollback_to_); rb.step(); }
+    StatementScope rel(release_);
+    rel.step();
+    return ok ? id : 0;
+}
+
+sqlite3_int64 Database::save_group_message(const std::string& from, sqlite3_int64 group_id, const std::string& group, const std::string& content,
+                                           const std::vector<std::string>& recipients, bool is_copy) {
+    ScopedTimer timer(metrics_.latency[DbMetrics::SaveGroupMessage]);
+    std::lock_guard<std::mutex> lock(mu_);
+    { StatementScope sp(savepoint_); if (sp.step() != SQLITE_DONE) return 0; }
+    sqlite3_int64 id = 0;
+    {
+        StatementScope q(insert_group_row_);
+        if (ids_) q.bind(1, ids_->fetch_add(1));
+        q.bind(2, from);
+        q.bind(3, group);
+        q.bind(4, content);
+        q.bind(5, group_id);
+        q.bind(6, is_copy ? 1 : 0);
+        if (q.step() == SQLITE_DONE) id = sqlite3_last_insert_rowid(db_.get());
+    }
+    for (const auto& r : recipients) {
+        if (!id) break;
+        StatementScope q(insert_delivery_);
+        q.bind(1, id);
+        q.bind(2, r);
+        if (q.step() != SQLITE_DONE) id = 0;
+    }
+    if (!id) { StatementScope rb(rollback_to_); rb.step(); }
+    StatementScope rel(release_);
+    rel.step();
+    return id;
 }
 
 bool Database::create_group(const std::string& group_name) {
-    const char* sql = "INSERT INTO groups (name) VALUES (?);";
-    sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) return false;
-    sqlite3_bind_text(stmt, 1, group_name.c_str(), -1, SQLITE_TRANSIENT);
-    bool ok = (sqlite3_step(stmt) == SQLITE_DONE);
-    sqlite3_finalize(stmt);
-    return ok;
+    ScopedTimer timer(metrics_.latency[DbMetrics::CreateGroup]);
+    std::lock_guard<std::mutex> lock(mu_);
+    StatementScope q(insert_group_);
+    q.bind(1, group_name);
+    if (q.step() != SQLITE_DONE) return false;
+    pending_group_ids_.emplace_back(group_name, sqlite3_last_insert_rowid(db_.get()));
+    invalidate_group(group_name);
+    return true;
 }
 
+// Id z cache (tylko zatwierdzone wiersze; nazwy użytkowników i grup się nie zmieniają),
+// przy braku - dotychczasowe INSERT ... SELECT po nazwach.
 void Database::add_to_group(const std::string& group_name, const std::string& username) {
-    const char* sql = 
-        "INSERT INTO group_members (group_id, user_id) "
-        "SELECT g.id, u.id FROM groups g, users u "
-        "WHERE g.name = ? AND u.username = ?;";
-    sqlite3_stmt* stmt = nullptr;
-    sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-    sqlite3_bind_text(stmt, 1, group_name.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    ScopedTimer timer(metrics_.latency[DbMetrics::AddToGroup]);
+    std::lock_guard<std::mutex> lock(mu_);
+    auto user = users_.get(username);
+    auto group_id = group_ids_.get(group_name);
+    if (!group_id) {
+        StatementScope q(select_group_id_);
+        q.bind(1, group_name);
+        // wiersz może pochodzić z bieżącej, niezatwierdzonej partii
+        if (q.step() == SQLITE_ROW) pending_group_ids_.emplace_back(group_name, q.int64(0));
+    }
+    if (user && *user && group_id) {
+        StatementScope q(insert_group_member_ids_);
+        q.bind(1, *group_id);
+        q.bind(2, (*user)->id);
+        q.step();
+    } else {
+        StatementScope q(insert_group_member_);
+        q.bind(1, group_name);
+        q.bind(2, username);
+        q.step();
+    }
+    invalidate_group(group_name);
 }
 
 std::optional<UserRecord> Database::get_user(const std::string& username) {
-    const char* sql = "SELECT salt, hash FROM users WHERE username = ?;";
-    sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) return std::nullopt;
-    sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_TRANSIENT);
-    UserRecord rec;
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        const unsigned char* salt = (const unsigned char*)sqlite3_column_blob(stmt, 0);
-        int salt_len = sqlite3_column_bytes(stmt, 0);
-        const unsigned char* hash = (const unsigned char*)sqlite3_column_blob(stmt, 1);
-        int hash_len = sqlite3_column_bytes(stmt, 1);
-        rec.salt.assign(salt, salt + salt_len);
-        rec.hash.assign(hash, hash + hash_len);
-        sqlite3_finalize(stmt);
-        return rec;
-    }
-    sqlite3_finalize(stmt);
-    return std::nullopt;
-}
-
-std::vector<MessageRecord> Database::get_history(const std::string& user, int limit) {
-    const char* sql = "SELECT sender, receiver, content, ts FROM messages WHERE sender = ? OR receiver = ? ORDER BY ts DESC LIMIT ?;";
-    sqlite3_stmt* stmt = nullptr;
-    sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-    sqlite3_bind_text(stmt, 1, user.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 2, user.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int(stmt, 3, limit);
+    ScopedTimer timer(metrics_.latency[DbMetrics::GetUser]);
+    if (auto cached = users_.get(username)) return *cached;
+    uint64_t gen = users_.generation();
+    std::optional<UserRecord> rec;
+    {
+        ReadLease r(*this);
+        StatementScope q(r->select_user);
+        q.bind(1, username);
+        if (q.step() == SQLITE_ROW) {
+            rec.emplace();
+            rec->id = q.int64(0);
+            rec->salt = q.blob(1);
+            rec->hash = q.blob(2);
+            rec->iterations = q.integer(3);
+        }
+    }
+    users_.put(username, rec, gen);
+    return rec;
+}
+
+std::vector<MessageRecord> Database::get_history(const std::string& user, sqlite3_int64 before_id, int limit) {
+    ScopedTimer timer(metrics_.latency[DbMetrics::GetHistory]);
+    ReadLease r(*this);
+    StatementScope q(r->select_history);
+    q.bind(1, user);
+    q.bind(2, limit);
+    q.bind(3, before_id > 0 ? before_id : std::numeric_limits<sqlite3_int64>::max());
     std::vector<MessageRecord> out;
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        MessageRecord m;
-        m.from = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        m.to = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        m.content = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        m.ts = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        out.push_back(m);
-    }
-    sqlite3_finalize(stmt);
+    while (q.step() == SQLITE_ROW) out.push_back(read_message(q));
     std::reverse(out.begin(), out.end());
     return out;
 }
 
-std::vector<MessageRecord> Database::get_undelivered(const std::string& user) {
-    const char* sql = "SELECT sender, receiver, content, ts FROM messages WHERE receiver = ? AND delivered = 0 ORDER BY ts;";
-    sqlite3_stmt* stmt = nullptr;
-    sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-    sqlite3_bind_text(stmt, 1, user.c_str(), -1, SQLITE_TRANSIENT);
+std::vector<MessageRecord> Database::get_sent(const std::string& user, sqlite3_int64 before_id, int limit) {
+    ScopedTimer timer(metrics_.latency[DbMetrics::GetHistory]);
+    ReadLease r(*this);
+    StatementScope q(r->select_sent);
+    q.bind(1, user);
+    q.bind(2, limit);
+    q.bind(3, before_id > 0 ? before_id : std::numeric_limits<sqlite3_int64>::max());
     std::vector<MessageRecord> out;
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        MessageRecord m;
-        m.from = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        m.to = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        m.content = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        m.ts = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        out.push_back(m);
-    }
-    sqlite3_finalize(stmt);
+    while (q.step() == SQLITE_ROW) out.push_back(read_message(q));
+    std::reverse(out.begin(), out.end());
     return out;
 }
 
-void Database::mark_delivered(const std::string& user) {
-    const char* sql = "UPDATE messages SET delivered = 1 WHERE receiver = ?;";
-    sqlite3_stmt* stmt = nullptr;
-    sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-    sqlite3_bind_text(stmt, 1, user.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+std::vector<MessageRecord> Database::get_undelivered(const std::string& user, sqlite3_int64 after_id, int limit) {
+    ScopedTimer timer(metrics_.latency[DbMetrics::GetUndelivered]);
+    ReadLease r(*this);
+    StatementScope q(r->select_undelivered);
+    q.bind(1, user);
+    q.bind(2, after_id);
+    q.bind(3, limit);
+    std::vector<MessageRecord> out;
+    while (q.step() == SQLITE_ROW) out.push_back(read_message(q));
+    return out;
 }
 
-std::string Database::get_stats(const std::string& username) {
-    const char* sql = "SELECT sent_count, last_sent FROM v_user_stats WHERE username = ?;";
-    sqlite3_stmt* stmt = nullptr;
-    std::string result = "No stats";
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_TRANSIENT);
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            int count = sqlite3_column_int(stmt, 0);
-            const char* last = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-            result = "Sent: " + std::to_string(count) + ", Last: " + (last ? last : "never");
+void Database::mark_delivered(const std::string& user, sqlite3_int64 up_to_id) {
+    ScopedTimer timer(metrics_.latency[DbMetrics::MarkDelivered]);
+    std::lock_guard<std::mutex> lock(mu_);
+    {
+        StatementScope q(update_delivered_);
+        q.bind(1, user);
+        q.bind(2, up_to_id);
+        q.step();
+    }
+    StatementScope q(update_group_delivered_);
+    q.bind(1, user);
+    q.bind(2, up_to_id);
+    q.step();
+}
+
+// Bezpośrednia albo grupowa - nie wiadomo której, więc druga tabela tylko przy braku trafienia.
+void Database::mark_delivered(const std::string& user, const std::vector<sqlite3_int64>& ids) {
+    ScopedTimer timer(metrics_.latency[DbMetrics::MarkDelivered]);
+    std::lock_guard<std::mutex> lock(mu_);
+    for (sqlite3_int64 id : ids) {
+        {
+            StatementScope q(update_delivered_id_);
+            q.bind(1, user);
+            q.bind(2, id);
+            if (q.step() == SQLITE_DONE && sqlite3_changes(db_.get()) > 0) continue;
         }
+        StatementScope q(update_group_delivered_id_);
+        q.bind(1, user);
+        q.bind(2, id);
+        q.step();
     }
-    sqlite3_finalize(stmt);
-    return result;
+}
+
+std::string Database::get_stats(const std::string& username) {
+    ScopedTimer timer(metrics_.latency[DbMetrics::GetStats]);
+    ReadLease r(*this);
+    StatementScope q(r->select_stats);
+    q.bind(1, username);
+    std::optional<UserStats> stats;
+    if (q.step() == SQLITE_ROW) stats = UserStats{q.int64(0), q.int64(1), q.int64(2), q.is_null(3) ? "" : q.text(3)};
+    return format_stats(stats);
+}
+
+std::optional<UserStats> Database::get_user_stats(const std::string& username) {
+    ScopedTimer timer(metrics_.latency[DbMetrics::GetStats]);
+    ReadLease r(*this);
+    StatementScope q(r->select_user_stats);
+    q.bind(1, username);
+    if (q.step() != SQLITE_ROW) return std::nullopt;
+    return UserStats{q.int64(0), q.int64(1), q.int64(2), q.is_null(3) ? "" : q.text(3)};
+}
+
+std::string format_stats(const std::optional<UserStats>& stats) {
+    if (!stats) return "No stats";
+    return "Sent: " + std::to_string(stats->sent) + " (group: " + std::to_string(stats->group) +
+           "), Received: " + std::to_string(stats->received) + ", Last: " + (stats->last_sent.empty() ? "never" : stats->last_sent);
+}
+
+void Database::rebuild_stats() {
+    std::lock_guard<std::mutex> lock(mu_);
+    rebuild_user_stats(db_.get());
 }
 
 std::vector<std::string> Database::get_group_members(const std::string& group_name) {
-    const char* sql = "SELECT u.username FROM users u JOIN group_members gm ON u.id = gm.user_id JOIN groups g ON g.id = gm.group_id WHERE g.name = ?;";
-    sqlite3_stmt* stmt = nullptr;
+    ScopedTimer timer(metrics_.latency[DbMetrics::GetGroupMembers]);
+    if (auto cached = group_members_.get(group_name)) return std::move(*cached);
+    uint64_t gen = group_members_.generation();
     std::vector<std::string> members;
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, group_name.c_str(), -1, SQLITE_TRANSIENT);
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            members.push_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
-        }
+    {
+        ReadLease r(*this);
+        StatementScope q(r->select_group_members);
+        q.bind(1, group_name);
+        while (q.step() == SQLITE_ROW) members.push_back(q.text(0));
     }
-    sqlite3_finalize(stmt);
+    group_members_.put(group_name, members, gen);
     return members;
 }
+
+// id jest niezmienne, więc zatwierdzony wiersz z połączenia do odczytu można cache'ować od razu
+std::optional<GroupRecord> Database::get_group(const std::string& group_name) {
+    auto id = group_ids_.get(group_name);
+    if (!id) {
+        uint64_t gen = group_ids_.generation();
+        {
+            ScopedTimer timer(metrics_.latency[DbMetrics::GetGroup]);
+            ReadLease r(*this);
+            StatementScope q(r->select_group_id);
+            q.bind(1, group_name);
+            if (q.step() == SQLITE_ROW) id = q.int64(0);
+        }
+        if (!id) return std::nullopt;
+        group_ids_.put(group_name, *id, gen);
+    }
+    return GroupRecord{*id, get_group_members(group_name)};
+}
+
+std::vector<std::string> Database::get_user_groups(const std::string& username) {
+    ScopedTimer timer(metrics_.latency[DbMetrics::GetUserGroups]);
+    ReadLease r(*this);
+    StatementScope q(r->select_user_groups);
+    q.bind(1, username);
+    std::vector<std::string> groups;
+    while (q.step() == SQLITE_ROW) groups.push_back(q.text(0));
+    return groups;
+}
+
+static std::string hex_token(char kind, const std::string& name) {
+    static const char digits[] = "0123456789abcdef";
+    std::string out(1, kind);
+    for (unsigned char c : name) {
+        out += digits[c >> 4];
+        out += digits[c & 15];
+    }
+    return out;
+}
+
+// Wyrażenie MATCH: owner : (u.. OR g..) AND content : ("słowo" "prefiks"*).
+// Każde słowo idzie w cudzysłowie, więc składnia FTS5 w zapytaniu użytkownika
+// (AND, NEAR, kolumny, nawiasy) jest zwykłym tekstem. Prefiks krótszy niż
+// kMinPrefix znaków jest szukany jako całe słowo - scalanie list wszystkich
+// pasujących słów kosztowałoby setki ms. "" = nic do szukania.
+static std::string fts_match(const std::string& user, const std::vector<std::string>& groups, const std::string& query) {
+    static const std::size_t kMaxTerms = 16;
+    static const std::size_t kMinPrefix = 3;
+    std::string terms;
+    std::size_t count = 0;
+    std::size_t pos = 0;
+    while (count < kMaxTerms) {
+        pos = query.find_first_not_of(" \t\r\n", pos);
+        if (pos == std::string::npos) break;
+        std::size_t end = query.find_first_of(" \t\r\n", pos);
+        std::string word = query.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        pos = end;
+        bool prefix = word.back() == '*';
+        while (!word.empty() && word.back() == '*') word.pop_back();
+        if (word.empty()) continue;
+        // długość w znakach UTF-8, tak jak liczy ją FTS5
+        auto chars = std::count_if(word.begin(), word.end(), [](char c) { return (static_cast<unsigned char>(c) & 0xC0) != 0x80; });
+        prefix = prefix && static_cast<std::size_t>(chars) >= kMinPrefix;
+        std::string quoted = "\"";
+        for (char c : word) quoted += c == '"' ? std::string("\"\"") : std::string(1, c);
+        terms += (count++ ? " " : "") + quoted + (prefix ? "\"*" : "\"");
+        if (end == std::string::npos) break;
+    }
+    if (terms.empty()) return "";
+    std::string owners = hex_token('u', user);
+    for (const auto& g : groups) owners += " OR " + hex_token('g', g);
+    return "owner : (" + owners + ") AND content : (" + terms + ")";
+}
+
+std::vector<SearchHit> Database::search(const std::string& user, const std::vector<std::string>& groups,
+                                        const std::string& query, int limit, int offset) {
+    ScopedTimer timer(metrics_.latency[DbMetrics::Search]);
+    std::string match = fts_match(user, groups, query);
+    std::vector<SearchHit> hits;
+    if (match.empty()) return hits;
+    ReadLease r(*this);
+    StatementScope q(r->select_search);
+    q.bind(1, user);
+    q.bind(2, match);
+    q.bind(3, limit);
+    q.bind(4, offset);
+    while (q.step() == SQLITE_ROW) hits.push_back({read_message(q), q.text(6), q.real(7)});
+    return hits;
+}
+
+sqlite3_int64 Database::max_message_id() {
+    std::lock_guard<std::mutex> lock(mu_);
+    Statement stmt(db_.get(), "SELECT COALESCE(MAX(id), 0) FROM messages;");
+    StatementScope q(stmt);
+    return q.step() == SQLITE_ROW ? q.int64(0) : 0;
+}
+
+std::size_t Database::storage_shards(std::size_t configured) {
+    std::lock_guard<std::mutex> lock(mu_);
+    {
+        Statement stmt(db_.get(), "SELECT shards FROM storage_layout;");
+        StatementScope q(stmt);
+        if (q.step() == SQLITE_ROW) return static_cast<std::size_t>(q.int64(0));
+    }
+    {
+        Statement stmt(db_.get(), "SELECT EXISTS (SELECT 1 FROM messages);");
+        StatementScope q(stmt);
+        if (q.step() == SQLITE_ROW && q.integer(0)) configured = 1;
+    }
+    Statement stmt(db_.get(), "INSERT INTO storage_layout (shards) VALUES (?);");
+    StatementScope q(stmt);
+    q.bind(1, static_cast<sqlite3_int64>(configured));
+    if (q.step() != SQLITE_DONE) throw std::runtime_error("cannot record storage layout");
+    return configured;
+}
+
+DatabaseCacheCounters Database::cache_counters() const {
+    return {users_.counters(), group_members_.counters(), group_ids_.counters()};
+}
+
+// Wołane pod mu_. Poza transakcją partii zapis jest już zatwierdzony.
+void Database::invalidate_user(const std::string& username) {
+    if (in_transaction_) pending_users_.push_back(username);
+    else users_.erase(username);
+}
+
+void Database::invalidate_group(const std::string& group_name) {
+    if (in_transaction_) pending_groups_.push_back(group_name);
+    else { group_members_.erase(group_name); apply_pending_cache(); }
+}
+
+void Database::apply_pending_cache() {
+    for (const auto& u : pending_users_) users_.erase(u);
+    for (const auto& g : pending_groups_) group_members_.erase(g);
+    for (const auto& [name, id] : pending_group_ids_) group_ids_.put(name, id, group_ids_.generation());
+    pending_users_.clear();
+    pending_groups_.clear();
+    pending_group_ids_.clear();
+}
+
+bool Database::begin() {
+    std::lock_guard<std::mutex> lock(mu_);
+    StatementScope q(begin_);
+    in_transaction_ = q.step() == SQLITE_DONE;
+    return in_transaction_;
+}
+
+bool Database::commit() {
+    ScopedTimer timer(metrics_.latency[DbMetrics::Commit]);
+    std::lock_guard<std::mutex> lock(mu_);
+    StatementScope q(commit_);
+    if (q.step() != SQLITE_DONE) return false;
+    in_transaction_ = false;
+    apply_pending_cache();
+    return true;
+}
+
+void Database::rollback() {
+    std::lock_guard<std::mutex> lock(mu_);
+    StatementScope q(rollback_);
+    q.step();
+    in_transaction_ = false;
+    // unieważnienia są nieszkodliwe, ale id z wycofanych wierszy nie mogą trafić do cache
+    pending_group_ids_.clear();
+    apply_pending_cache();
+}
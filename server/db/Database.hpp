@@ -1,35 +1,207 @@
 #pragma once
 #include <sqlite3.h>
+#include "Statement.hpp"
+#include "../util/LruCache.hpp"
+#include "../util/Metrics.hpp"
+#include <array>
+#include <atomic>
 #include <string>
 #include <vector>
 #include <optional>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 
 struct UserRecord {
+    sqlite3_int64 id = 0;
     std::vector<unsigned char> salt;
     std::vector<unsigned char> hash;
+    int iterations = 0;
 };
 
 struct MessageRecord {
+    sqlite3_int64 id = 0;
     std::string from;
     std::string to;
     std::string content;
     std::string ts;
+    std::string group; // niepuste dla wiadomości grupowych (wtedy to == group)
 };
 
+// Trafienie wyszukiwania: rank to bm25 (mniejszy = trafniejszy), snippet z [ ] wokół słów.
+struct SearchHit {
+    MessageRecord message;
+    std::string snippet;
+    double rank = 0;
+};
+
+struct GroupRecord {
+    sqlite3_int64 id = 0;
+    std::vector<std::string> members;
+};
+
+// Surowe liczniki z user_stats; w trybie shardów sumowane po wszystkich plikach.
+struct UserStats {
+    sqlite3_int64 sent = 0;
+    sqlite3_int64 received = 0;
+    sqlite3_int64 group = 0;
+    std::string last_sent; // puste = nigdy
+};
+
+std::string format_stats(const std::optional<UserStats>& stats);
+
+struct DatabaseOptions {
+    std::size_t readers = 4;               // połączenia tylko do odczytu
+    std::string synchronous = "FULL";      // OFF | NORMAL | FULL | EXTRA
+    int cache_size_kib = 16384;            // PRAGMA cache_size na połączenie
+    long long mmap_size = 268435456;       // PRAGMA mmap_size (0 = wyłączone)
+    int busy_timeout_ms = 5000;
+    std::size_t cache_users = 10000;       // rekordy użytkowników (także "nie istnieje")
+    std::size_t cache_groups = 1000;       // listy członków i id grup
+    bool foreign_keys = true;              // shard: false, tabele users/groups są tam puste
+};
+
+struct DatabaseCacheCounters {
+    CacheCounters users;
+    CacheCounters group_members;
+    CacheCounters group_ids;
+};
+
+// Czas wykonania metod Database (z oczekiwaniem na połączenie/blokadę).
+struct DbMetrics {
+    enum Method {
+        CreateUser, GetUser, SaveMessage, SaveGroupMessage, GetHistory, GetUndelivered,
+        MarkDelivered, GetStats, CreateGroup, AddToGroup, GetGroupMembers, GetGroup,
+        GetUserGroups, Search, Commit, Count
+    };
+    static const char* name(Method m);
+    std::array<LatencyHistogram, Count> latency;
+};
+
+// Baza w trybie WAL: jedno połączenie zapisujące (używane przez DbExecutor)
+// i pula połączeń tylko do odczytu. Odczyty biorą wolne połączenie z puli,
+// więc długi get_history nie blokuje zapisów i odwrotnie.
 class Database {
 public:
-    explicit Database(const std::string& path);
+    explicit Database(const std::string& path, const DatabaseOptions& opts = DatabaseOptions());
     ~Database();
-    bool create_user(const std::string& username, const std::vector<unsigned char>& salt, const std::vector<unsigned char>& hash);
+    bool create_user(const std::string& username, const std::vector<unsigned char>& salt, const std::vector<unsigned char>& hash, int iterations);
     std::optional<UserRecord> get_user(const std::string& username);
-    bool save_message(const std::string& from, const std::string& to, const std::string& content);
-    std::vector<MessageRecord> get_history(const std::string& user, int limit = 20);
-    std::vector<MessageRecord> get_undelivered(const std::string& user);
-    void mark_delivered(const std::string& user);
+    // Zwracają id zapisanej wiadomości, 0 gdy zapis odrzucono.
+    sqlite3_int64 save_message(const std::string& from, const std::string& to, const std::string& content);
+    // Jeden wiersz w messages + wiersz dostarczenia dla każdego członka poza nadawcą.
+    sqlite3_int64 save_group_message(const std::string& from, const std::string& group, const std::string& content);
+    // Wariant dla shardów: członkowie z katalogu, tu tylko odbiorcy z tego pliku.
+    // is_copy = true dla shardów innych niż shard nadawcy.
+    sqlite3_int64 save_group_message(const std::string& from, sqlite3_int64 group_id, const std::string& group, const std::string& content,
+                                     const std::vector<std::string>& recipients, bool is_copy);
+    // Strona historii: do limit wiadomości starszych niż before_id (0 = od najnowszych),
+    // w kolejności chronologicznej.
+    std::vector<MessageRecord> get_history(const std::string& user, sqlite3_int64 before_id = 0, int limit = 20);
+    // Tylko wysłane przez user (gałąź historii dla shardów innych niż jego własny).
+    std::vector<MessageRecord> get_sent(const std::string& user, sqlite3_int64 before_id, int limit);
+    // Kolejna porcja niedostarczonych (id > after_id), rosnąco po id.
+    std::vector<MessageRecord> get_undelivered(const std::string& user, sqlite3_int64 after_id, int limit);
+    // Wszystkie wiadomości user o id <= up_to_id (narzędzia, db_bench).
+    void mark_delivered(const std::string& user, sqlite3_int64 up_to_id);
+    // Dokładnie te id - to, co sesja faktycznie wysłała i klient potwierdził.
+    void mark_delivered(const std::string& user, const std::vector<sqlite3_int64>& ids);
     std::string get_stats(const std::string& username);
+    std::optional<UserStats> get_user_stats(const std::string& username);
+    void rebuild_stats();
     bool create_group(const std::string& group_name);
     void add_to_group(const std::string& group_name, const std::string& username);
     std::vector<std::string> get_group_members(const std::string& group_name);
+    std::optional<GroupRecord> get_group(const std::string& group_name);
+    std::vector<std::string> get_user_groups(const std::string& username);
+    // Pełnotekstowo po wiadomościach user: wysłanych, bezpośrednio odebranych
+    // i dostarczonych z grup (groups - jego grupy, pozostałe są pomijane).
+    // query to słowa, wszystkie muszą wystąpić; "słowo*" = prefiks. Kolejność
+    // po trafności, potem od najnowszych.
+    std::vector<SearchHit> search(const std::string& user, const std::vector<std::string>& groups,
+                                  const std::string& query, int limit, int offset);
+
+    // Tryb shardów: id wiadomości z jednej sekwencji wspólnej dla wszystkich plików
+    // (unikalne i porównywalne między shardami). Bez niej - AUTOINCREMENT.
+    void set_id_sequence(std::atomic<sqlite3_int64>* ids) { ids_ = ids; }
+    sqlite3_int64 max_message_id();
+    // Liczba shardów zapisana w katalogu. Baza bez zapisu przyjmuje configured,
+    // chyba że ma już wiadomości - wtedy to zwykły chat.db (1).
+    std::size_t storage_shards(std::size_t configured);
+
+    // transakcje partii zapisów (DbExecutor)
+    bool begin();
+    bool commit();
+    void rollback();
+
+    DatabaseCacheCounters cache_counters() const;
+    const DbMetrics& metrics() const { return metrics_; }
+
+    // Zapytania z gorących ścieżek, które w planie mają pełny skan tabeli (powinno być pusto).
+    std::vector<std::string> check_query_plans();
 private:
-    sqlite3* db_;
+    struct Reader {
+        SqliteHandle db;
+        Statement select_user;
+        Statement select_history;
+        Statement select_sent;
+        Statement select_undelivered;
+        Statement select_stats;
+        Statement select_user_stats;
+        Statement select_group_members;
+        Statement select_group_id;
+        Statement select_user_groups;
+        Statement select_search;
+    };
+    class ReadLease;
+
+    Reader* acquire_reader();
+    void release_reader(Reader* reader);
+    void invalidate_user(const std::string& username);
+    void invalidate_group(const std::string& group_name);
+    void apply_pending_cache();
+
+    // połączenie zapisujące; mutex chroni jego zapytania z cache
+    std::mutex mu_;
+    SqliteHandle db_;
+
+    Statement insert_user_;
+    Statement insert_message_;
+    Statement insert_group_message_;
+    Statement insert_group_deliveries_;
+    Statement insert_group_row_;
+    Statement insert_delivery_;
+    Statement insert_group_;
+    Statement insert_group_member_;
+    Statement insert_group_member_ids_;
+    Statement select_group_id_;
+    Statement update_delivered_;
+    Statement update_group_delivered_;
+    Statement update_delivered_id_;
+    Statement update_group_delivered_id_;
+    Statement begin_;
+    Statement commit_;
+    Statement rollback_;
+    Statement savepoint_;
+    Statement release_;
+    Statement rollback_to_;
+
+    // Cache przed zapytaniami odczytu. Zapisy z transakcji partii unieważniają wpisy
+    // dopiero po COMMIT (pending_*), inaczej czytelnik mógłby między unieważnieniem
+    // a commitem wczytać stary stan z powrotem. Id z niezatwierdzonej transakcji
+    // trafiają do cache tylko po udanym commicie.
+    LruCache<std::string, std::optional<UserRecord>> users_;
+    LruCache<std::string, std::vector<std::string>> group_members_;
+    LruCache<std::string, sqlite3_int64> group_ids_;
+    DbMetrics metrics_;
+    std::atomic<sqlite3_int64>* ids_ = nullptr;
+    bool in_transaction_ = false;
+    std::vector<std::string> pending_users_;
+    std::vector<std::string> pending_groups_;
+    std::vector<std::pair<std::string, sqlite3_int64>> pending_group_ids_;
+
+    std::vector<std::unique_ptr<Reader>> readers_;
+    std::vector<Reader*> free_readers_;
+    std::mutex readers_mu_;
+    std::condition_variable readers_cv_;
 };
@@ -0,0 +1,70 @@
+#include "DbExecutor.hpp"
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+DbExecutor::DbExecutor(Database& db, std::size_t max_batch, std::chrono::microseconds max_delay)
+    : db_(db), max_batch_(std::max<std::size_t>(1, max_batch)), max_delay_(max_delay), thread_([this]() { run(); }) {}
+
+DbExecutor::~DbExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+void DbExecutor::submit(Op op, Done done) {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        queue_.push_back({std::move(op), std::move(done)});
+    }
+    cv_.notify_one();
+}
+
+std::size_t DbExecutor::queue_depth() {
+    std::lock_guard<std::mutex> lock(mu_);
+    return queue_.size();
+}
+
+void DbExecutor::run() {
+    std::deque<Request> batch;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mu_);
+            cv_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) return; // stop_ i nic do zapisania
+            // krótko czekamy na kolejne zapisy, żeby jeden fsync objął całą partię
+            auto deadline = std::chrono::steady_clock::now() + max_delay_;
+            cv_.wait_until(lock, deadline, [this]() { return stop_ || queue_.size() >= max_batch_; });
+            std::size_t n = std::min(queue_.size(), max_batch_);
+            for (std::size_t i = 0; i < n; ++i) {
+                batch.push_back(std::move(queue_.front()));
+                queue_.pop_front();
+            }
+        }
+        commit_batch(batch);
+        batches_.fetch_add(1, std::memory_order_relaxed);
+        ops_.fetch_add(batch.size(), std::memory_order_relaxed);
+        batch.clear();
+    }
+}
+
+void DbExecutor::commit_batch(std::deque<Request>& batch) {
+    std::vector<bool> results;
+    results.reserve(batch.size());
+    bool committed = db_.begin();
+    if (committed) {
+        for (auto& r : batch) {
+            bool ok = false;
+            try { ok = r.op(db_); } catch (const std::exception& e) { std::cerr << "DB write failed: " << e.what() << "\n"; }
+            results.push_back(ok);
+        }
+        committed = db_.commit();
+        if (!committed) db_.rollback();
+    }
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        if (batch[i].done) batch[i].done(committed && results[i]);
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "Database.hpp"
+
+// Jedyny wątek zapisujący do bazy. Zlecenia z sesji trafiają do kolejki i są
+// zatwierdzane grupami w jednej transakcji (group commit): partia zamyka się po
+// max_batch zleceniach albo po max_delay od pierwszego. Callback done dostaje
+// wynik dopiero po COMMIT, czyli gdy zapis jest trwały; wołany jest z wątku
+// executora, więc sesja sama wraca na swój strand.
+class DbExecutor {
+public:
+    using Op = std::function<bool(Database&)>;
+    using Done = std::function<void(bool ok)>;
+
+    DbExecutor(Database& db, std::size_t max_batch, std::chrono::microseconds max_delay);
+    ~DbExecutor();
+    DbExecutor(const DbExecutor&) = delete;
+    DbExecutor& operator=(const DbExecutor&) = delete;
+
+    void submit(Op op, Done done = nullptr);
+
+    std::size_t queue_depth();
+    uint64_t batches() const { return batches_.load(std::memory_order_relaxed); }
+    uint64_t ops() const { return ops_.load(std::memory_order_relaxed); }
+
+private:
+    struct Request {
+        Op op;
+        Done done;
+    };
+
+    void run();
+    void commit_batch(std::deque<Request>& batch);
+
+    Database& db_;
+    std::size_t max_batch_;
+    std::chrono::microseconds max_delay_;
+
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::deque<Request> queue_;
+    bool stop_ = false;
+    std::atomic<uint64_t> batches_{0};
+    std::atomic<uint64_t> ops_{0};
+    std::thread thread_;
+};
@@ -0,0 +1,245 @@
+#include "Migrations.hpp"
+#include "Statement.hpp"
+#include <stdexcept>
+
+// Przeliczenie user_stats od zera (pełne skany - tylko migracja i --rebuild-stats).
+// Odebrane: bezpośrednie z messages + grupowe z message_deliveries.
+// Wersja z migracji 7, sprzed kolumny is_copy.
+#define REBUILD_USER_STATS_SQL_V7 \
+    "DELETE FROM user_stats;" \
+    "INSERT INTO user_stats (username, sent_count, received_count, group_count, last_sent) " \
+    "SELECT username, SUM(sent), SUM(received), SUM(grp), MAX(last) FROM (" \
+    "SELECT sender AS username, 1 AS sent, 0 AS received, group_id IS NOT NULL AS grp, ts AS last FROM messages " \
+    "UNION ALL SELECT receiver, 0, 1, 0, NULL FROM messages WHERE group_id IS NULL " \
+    "UNION ALL SELECT receiver, 0, 1, 0, NULL FROM message_deliveries" \
+    ") GROUP BY username;"
+
+// Kopie wiadomości grupowych z innych shardów nie liczą się nadawcy drugi raz.
+#define REBUILD_USER_STATS_SQL \
+    "DELETE FROM user_stats;" \
+    "INSERT INTO user_stats (username, sent_count, received_count, group_count, last_sent) " \
+    "SELECT username, SUM(sent), SUM(received), SUM(grp), MAX(last) FROM (" \
+    "SELECT sender AS username, 1 AS sent, 0 AS received, group_id IS NOT NULL AS grp, ts AS last FROM messages WHERE is_copy = 0 " \
+    "UNION ALL SELECT receiver, 0, 1, 0, NULL FROM messages WHERE group_id IS NULL " \
+    "UNION ALL SELECT receiver, 0, 1, 0, NULL FROM message_deliveries" \
+    ") GROUP BY username;"
+
+// Tokeny właścicieli wiersza dla kolumny owner w messages_fts (row = "", "NEW." albo "OLD.").
+// hex() daje same znaki alfanumeryczne, więc dowolna nazwa jest jednym tokenem.
+#define FTS_OWNER_SQL(row) \
+    "'u' || hex(" row "sender) || ' ' || CASE WHEN " row "group_id IS NULL THEN 'u' ELSE 'g' END || hex(" row "receiver)"
+
+const std::vector<Migration>& schema_migrations() {
+    static const std::vector<Migration> migrations = {
+        {1,
+         "CREATE TABLE IF NOT EXISTS users ("
+         "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+         "username TEXT UNIQUE NOT NULL,"
+         "salt BLOB NOT NULL,"
+         "hash BLOB NOT NULL"
+         ");"
+         "CREATE TABLE IF NOT EXISTS messages ("
+         "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+         "sender TEXT NOT NULL,"
+         "receiver TEXT NOT NULL,"
+         "content TEXT NOT NULL,"
+         "ts DATETIME DEFAULT CURRENT_TIMESTAMP,"
+         "delivered INTEGER DEFAULT 0"
+         ");"
+         "CREATE TABLE IF NOT EXISTS groups ("
+         "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+         "name TEXT UNIQUE NOT NULL"
+         ");"
+         "CREATE TABLE IF NOT EXISTS group_members ("
+         "group_id INTEGER, user_id INTEGER,"
+         "FOREIGN KEY(group_id) REFERENCES groups(id), "
+         "FOREIGN KEY(user_id) REFERENCES users(id)"
+         ");"
+         "CREATE VIEW IF NOT EXISTS v_user_stats AS "
+         "SELECT u.username, "
+         "(SELECT COUNT(*) FROM messages WHERE sender = u.username) as sent_count, "
+         "(SELECT MAX(ts) FROM messages WHERE sender = u.username) as last_sent "
+         "FROM users u;"
+         "CREATE TRIGGER IF NOT EXISTS trg_prevent_self_msg "
+         "BEFORE INSERT ON messages "
+         "WHEN NEW.sender = NEW.receiver "
+         "BEGIN "
+         "SELECT RAISE(ABORT, 'Cannot send message to yourself'); "
+         "END;"},
+        // historia (sender/receiver po ts), statystyki (COUNT/MAX po sender),
+        // niedostarczone (częściowy indeks tylko na delivered = 0), członkowie grup
+        {2,
+         "CREATE INDEX IF NOT EXISTS idx_messages_sender_ts ON messages(sender, ts);"
+         "CREATE INDEX IF NOT EXISTS idx_messages_receiver_ts ON messages(receiver, ts);"
+         "CREATE INDEX IF NOT EXISTS idx_messages_undelivered ON messages(receiver, ts) WHERE delivered = 0;"
+         "CREATE INDEX IF NOT EXISTS idx_group_members_group ON group_members(group_id, user_id);"},
+        // liczba iteracji PBKDF2 zapisana przy koncie - zmiana konfiguracji nie psuje starych haseł
+        {3,
+         "ALTER TABLE users ADD COLUMN iterations INTEGER NOT NULL DEFAULT 120000;"},
+        // wiadomość grupowa zapisana raz (receiver = nazwa grupy, group_id ustawione),
+        // stan dostarczenia per odbiorca w wąskiej tabeli message_deliveries;
+        // delivered = 1 w messages trzyma takie wiersze poza indeksem niedostarczonych
+        {4,
+         "ALTER TABLE messages ADD COLUMN group_id INTEGER REFERENCES groups(id);"
+         "CREATE TABLE IF NOT EXISTS message_deliveries ("
+         "message_id INTEGER NOT NULL REFERENCES messages(id),"
+         "receiver TEXT NOT NULL,"
+         "delivered INTEGER NOT NULL DEFAULT 0,"
+         "PRIMARY KEY (receiver, message_id)"
+         ") WITHOUT ROWID;"
+         "CREATE INDEX IF NOT EXISTS idx_deliveries_undelivered ON message_deliveries(receiver, message_id) WHERE delivered = 0;"
+         // bez tego klucz obcy skanuje message_deliveries przy każdym INSERT do messages
+         "CREATE INDEX IF NOT EXISTS idx_deliveries_message ON message_deliveries(message_id);"
+         "DROP TRIGGER IF EXISTS trg_prevent_self_msg;"
+         "CREATE TRIGGER trg_prevent_self_msg "
+         "BEFORE INSERT ON messages "
+         "WHEN NEW.group_id IS NULL AND NEW.sender = NEW.receiver "
+         "BEGIN "
+         "SELECT RAISE(ABORT, 'Cannot send message to yourself'); "
+         "END;"},
+        // historia stronicowana po id (keyset): wysłane i bezpośrednio odebrane;
+        // grupowe idą po kluczu głównym message_deliveries (receiver, message_id)
+        {5,
+         "CREATE INDEX IF NOT EXISTS idx_messages_sender_id ON messages(sender, id);"
+         "CREATE INDEX IF NOT EXISTS idx_messages_receiver_id ON messages(receiver, id) WHERE group_id IS NULL;"
+         "DROP INDEX IF EXISTS idx_messages_receiver_ts;"},
+        // zaległe wiadomości czytane porcjami po id i potwierdzane do id
+        {6,
+         "DROP INDEX IF EXISTS idx_messages_undelivered;"
+         "CREATE INDEX idx_messages_undelivered ON messages(receiver, id) WHERE delivered = 0;"},
+        // Liczniki per użytkownik zamiast widoku z COUNT/MAX po całej tabeli.
+        // Triggery aktualizują je w tej samej instrukcji co INSERT, więc zawsze
+        // w tej samej transakcji; /stats to jedno wyszukanie po kluczu.
+        {7,
+         "CREATE TABLE user_stats ("
+         "username TEXT PRIMARY KEY,"
+         "sent_count INTEGER NOT NULL DEFAULT 0,"
+         "received_count INTEGER NOT NULL DEFAULT 0,"
+         "group_count INTEGER NOT NULL DEFAULT 0,"
+         "last_sent TEXT"
+         ") WITHOUT ROWID;"
+         "CREATE TRIGGER trg_stats_message AFTER INSERT ON messages "
+         "BEGIN "
+         "INSERT INTO user_stats (username, sent_count, group_count, last_sent) "
+         "VALUES (NEW.sender, 1, NEW.group_id IS NOT NULL, NEW.ts) "
+         "ON CONFLICT(username) DO UPDATE SET sent_count = sent_count + 1, "
+         "group_count = group_count + excluded.group_count, last_sent = excluded.last_sent; "
+         "INSERT INTO user_stats (username, received_count) SELECT NEW.receiver, 1 WHERE NEW.group_id IS NULL "
+         "ON CONFLICT(username) DO UPDATE SET received_count = received_count + 1; "
+         "END;"
+         "CREATE TRIGGER trg_stats_delivery AFTER INSERT ON message_deliveries "
+         "BEGIN "
+         "INSERT INTO user_stats (username, received_count) VALUES (NEW.receiver, 1) "
+         "ON CONFLICT(username) DO UPDATE SET received_count = received_count + 1; "
+         "END;"
+         REBUILD_USER_STATS_SQL_V7
+         "DROP VIEW IF EXISTS v_user_stats;"
+         "DROP INDEX IF EXISTS idx_messages_sender_ts;"},
+        // Shardy: wiadomość grupowa leży w shardzie nadawcy (oryginał) i jako kopia
+        // (is_copy = 1) w shardach pozostałych odbiorców, tylko dla ich dostarczeń.
+        // Historia wysłanych i liczniki nadawcy patrzą wyłącznie na oryginały.
+        // storage_layout w katalogu pamięta liczbę shardów.
+        {8,
+         "ALTER TABLE messages ADD COLUMN is_copy INTEGER NOT NULL DEFAULT 0;"
+         "DROP INDEX IF EXISTS idx_messages_sender_id;"
+         "CREATE INDEX idx_messages_sender_id ON messages(sender, id) WHERE is_copy = 0;"
+         "DROP TRIGGER IF EXISTS trg_stats_message;"
+         "CREATE TRIGGER trg_stats_message AFTER INSERT ON messages WHEN NEW.is_copy = 0 "
+         "BEGIN "
+         "INSERT INTO user_stats (username, sent_count, group_count, last_sent) "
+         "VALUES (NEW.sender, 1, NEW.group_id IS NOT NULL, NEW.ts) "
+         "ON CONFLICT(username) DO UPDATE SET sent_count = sent_count + 1, "
+         "group_count = group_count + excluded.group_count, last_sent = excluded.last_sent; "
+         "INSERT INTO user_stats (username, received_count) SELECT NEW.receiver, 1 WHERE NEW.group_id IS NULL "
+         "ON CONFLICT(username) DO UPDATE SET received_count = received_count + 1; "
+         "END;"
+         "CREATE TABLE storage_layout (shards INTEGER NOT NULL);"},
+        // Wyszukiwanie pełnotekstowe: FTS5 z zewnętrzną treścią (tekst tylko w messages).
+        // Kolumna owner to tokeny u<hex nadawcy> i u/g<hex odbiorcy albo grupy>, więc
+        // zawężenie do rozmówcy robi sam MATCH (przecięcie list w indeksie) zamiast
+        // filtrowania wszystkich trafień słowa. Triggery trzymają indeks w tej samej
+        // transakcji co messages; 'rebuild' indeksuje istniejące wiersze (jednorazowo).
+        // prefix='3': "abc*" to jedna lista zamiast scalania wszystkich słów na abc.
+        {9,
+         "CREATE VIEW messages_fts_source AS SELECT id, content, " FTS_OWNER_SQL("") " AS owner FROM messages;"
+         "CREATE VIRTUAL TABLE messages_fts USING fts5(content, owner, content='messages_fts_source', content_rowid='id', prefix='3');"
+         "CREATE TRIGGER trg_fts_insert AFTER INSERT ON messages "
+         "BEGIN "
+         "INSERT INTO messages_fts (rowid, content, owner) VALUES (NEW.id, NEW.content, " FTS_OWNER_SQL("NEW.") "); "
+         "END;"
+         "CREATE TRIGGER trg_fts_delete AFTER DELETE ON messages "
+         "BEGIN "
+         "INSERT INTO messages_fts (messages_fts, rowid, content, owner) VALUES ('delete', OLD.id, OLD.content, " FTS_OWNER_SQL("OLD.") "); "
+         "END;"
+         "CREATE TRIGGER trg_fts_update AFTER UPDATE OF content, sender, receiver, group_id ON messages "
+         "BEGIN "
+         "INSERT INTO messages_fts (messages_fts, rowid, content, owner) VALUES ('delete', OLD.id, OLD.content, " FTS_OWNER_SQL("OLD.") "); "
+         "INSERT INTO messages_fts (rowid, content, owner) VALUES (NEW.id, NEW.content, " FTS_OWNER_SQL("NEW.") "); "
+         "END;"
+         "INSERT INTO messages_fts (messages_fts) VALUES ('rebuild');"
+         // grupy użytkownika (zakres wyszukiwania)
+         "CREATE INDEX idx_group_members_user ON group_members(user_id, group_id);"},
+    };
+    return migrations;
+}
+
+int schema_version(sqlite3* db) {
+    Statement stmt(db, "PRAGMA user_version;");
+    StatementScope q(stmt);
+    return q.step() == SQLITE_ROW ? q.integer(0) : 0;
+}
+
+static void exec_or_throw(sqlite3* db, const std::string& sql) {
+    char* err = nullptr;
+    if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &err) != SQLITE_OK) {
+        std::string msg = err ? err : "unknown error";
+        sqlite3_free(err);
+        throw std::runtime_error(msg);
+    }
+}
+
+void run_migrations(sqlite3* db) {
+    int current = schema_version(db);
+    for (const auto& m : schema_migrations()) {
+        if (m.version <= current) continue;
+        try {
+            exec_or_throw(db, "BEGIN IMMEDIATE;");
+            exec_or_throw(db, m.sql);
+            exec_or_throw(db, "PRAGMA user_version = " + std::to_string(m.version) + ";");
+            exec_or_throw(db, "COMMIT;");
+        } catch (const std::exception& e) {
+            sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+            throw std::runtime_error("migration " + std::to_string(m.version) + " failed: " + e.what());
+        }
+        current = m.version;
+    }
+}
+
+void rebuild_user_stats(sqlite3* db) {
+    try {
+        exec_or_throw(db, "BEGIN IMMEDIATE;");
+        exec_or_throw(db, REBUILD_USER_STATS_SQL);
+        exec_or_throw(db, "COMMIT;");
+    } catch (const std::exception& e) {
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        throw std::runtime_error(std::string("stats rebuild failed: ") + e.what());
+    }
+}
+
+std::vector<std::string> find_table_scans(sqlite3* db, const std::vector<std::string>& queries) {
+    std::vector<std::string> scans;
+    for (const auto& sql : queries) {
+        Statement stmt(db, ("EXPLAIN QUERY PLAN " + sql).c_str());
+        StatementScope q(stmt);
+        while (q.step() == SQLITE_ROW) {
+            std::string detail = q.text(3);
+            // SCAN (subquery-N) / SCAN CONSTANT ROW to tylko kilka wierszy pośrednich,
+            // a SCAN tabeli FTS5 z MATCH (":M" w planie) to wyszukanie w jej indeksie
+            bool fts = detail.find("VIRTUAL TABLE INDEX") != std::string::npos && detail.find(":M") != std::string::npos;
+            if (detail.rfind("SCAN ", 0) == 0 && detail.rfind("SCAN (", 0) != 0 && detail.rfind("SCAN CONSTANT", 0) != 0 && !fts) {
+                scans.push_back(sql + " -> " + detail);
+            }
+        }
+    }
+    return scans;
+}
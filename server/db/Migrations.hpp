@@ -0,0 +1,22 @@
+#pragma once
+#include <sqlite3.h>
+#include <string>
+#include <vector>
+
+// Migracje schematu numerowane przez PRAGMA user_version.
+// Każda migracja wykonuje się w osobnej transakcji razem z podbiciem wersji,
+// więc istniejący chat.db jest aktualizowany na miejscu przy starcie serwera.
+struct Migration {
+    int version;
+    const char* sql;
+};
+
+const std::vector<Migration>& schema_migrations();
+int schema_version(sqlite3* db);
+void run_migrations(sqlite3* db);
+
+// Przelicza user_stats z messages/message_deliveries (np. po ręcznej edycji bazy).
+void rebuild_user_stats(sqlite3* db);
+
+// EXPLAIN QUERY PLAN dla podanych zapytań; zwraca opisy pełnych skanów tabel.
+std::vector<std::string> find_table_scans(sqlite3* db, const std::vector<std::string>& queries);
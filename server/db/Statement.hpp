@@ -0,0 +1,80 @@
+#pragma once
+#include <sqlite3.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// close_v2: połączenie zostaje zamknięte dopiero po sfinalizowaniu wszystkich zapytań
+struct SqliteCloser {
+    void operator()(sqlite3* db) const { sqlite3_close_v2(db); }
+};
+using SqliteHandle = std::unique_ptr<sqlite3, SqliteCloser>;
+
+// Zapytanie kompilowane raz przy starcie i finalizowane w destruktorze.
+class Statement {
+public:
+    Statement() = default;
+    Statement(sqlite3* db, const char* sql) {
+        if (sqlite3_prepare_v3(db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt_, nullptr) != SQLITE_OK) {
+            std::string err = sqlite3_errmsg(db);
+            sqlite3_finalize(stmt_);
+            throw std::runtime_error("cannot prepare statement: " + err);
+        }
+    }
+    ~Statement() { sqlite3_finalize(stmt_); }
+
+    Statement(Statement&& other) noexcept : stmt_(std::exchange(other.stmt_, nullptr)) {}
+    Statement& operator=(Statement&& other) noexcept {
+        if (this != &other) {
+            sqlite3_finalize(stmt_);
+            stmt_ = std::exchange(other.stmt_, nullptr);
+        }
+        return *this;
+    }
+    Statement(const Statement&) = delete;
+    Statement& operator=(const Statement&) = delete;
+
+    sqlite3_stmt* get() const { return stmt_; }
+
+private:
+    sqlite3_stmt* stmt_ = nullptr;
+};
+
+// Jedno użycie przygotowanego zapytania. Destruktor robi reset + clear_bindings,
+// więc zapytanie wraca do cache w stanie gotowym także na ścieżkach błędów.
+class StatementScope {
+public:
+    explicit StatementScope(Statement& stmt) : stmt_(stmt.get()) {}
+    ~StatementScope() {
+        sqlite3_reset(stmt_);
+        sqlite3_clear_bindings(stmt_);
+    }
+    StatementScope(const StatementScope&) = delete;
+    StatementScope& operator=(const StatementScope&) = delete;
+
+    // Parametry żyją do końca scope'u, więc SQLITE_STATIC jest bezpieczne.
+    void bind(int idx, const std::string& v) { sqlite3_bind_text(stmt_, idx, v.data(), (int)v.size(), SQLITE_STATIC); }
+    void bind(int idx, const std::vector<unsigned char>& v) { sqlite3_bind_blob(stmt_, idx, v.data(), (int)v.size(), SQLITE_STATIC); }
+    void bind(int idx, int v) { sqlite3_bind_int(stmt_, idx, v); }
+    void bind(int idx, sqlite3_int64 v) { sqlite3_bind_int64(stmt_, idx, v); }
+
+    int step() { return sqlite3_step(stmt_); }
+
+    std::string text(int col) const {
+        const unsigned char* p = sqlite3_column_text(stmt_, col);
+        return p ? std::string(reinterpret_cast<const char*>(p), sqlite3_column_bytes(stmt_, col)) : std::string();
+    }
+    std::vector<unsigned char> blob(int col) const {
+        auto p = static_cast<const unsigned char*>(sqlite3_column_blob(stmt_, col));
+        return p ? std::vector<unsigned char>(p, p + sqlite3_column_bytes(stmt_, col)) : std::vector<unsigned char>();
+    }
+    int integer(int col) const { return sqlite3_column_int(stmt_, col); }
+    sqlite3_int64 int64(int col) const { return sqlite3_column_int64(stmt_, col); }
+    double real(int col) const { return sqlite3_column_double(stmt_, col); }
+    bool is_null(int col) const { return sqlite3_column_type(stmt_, col) == SQLITE_NULL; }
+
+private:
+    sqlite3_stmt* stmt_;
+};
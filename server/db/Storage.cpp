@@ -0,0 +1,181 @@
+#include "Storage.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+
+Storage::Storage(const std::string& path, std::size_t shards, const DatabaseOptions& opts,
+                 std::size_t max_batch, std::chrono::microseconds max_delay) {
+    if (shards < 1) throw std::invalid_argument("shard count must be positive");
+    dbs_.push_back(std::make_unique<Database>(path, opts));
+    catalog_ = dbs_[0].get();
+    std::size_t stored = catalog_->storage_shards(shards);
+    if (stored != shards) {
+        throw std::runtime_error(path + " is laid out for " + std::to_string(stored) + " shard(s), not " +
+                                 std::to_string(shards) + "; convert it with chat_reshard");
+    }
+    if (shards == 1) {
+        shards_.push_back(catalog_);
+    } else {
+        DatabaseOptions shard_opts = opts;
+        shard_opts.foreign_keys = false;
+        sqlite3_int64 max_id = 0;
+        for (std::size_t i = 0; i < shards; ++i) {
+            dbs_.push_back(std::make_unique<Database>(shard_path(path, i), shard_opts));
+            shards_.push_back(dbs_.back().get());
+            max_id = std::max(max_id, shards_.back()->max_message_id());
+        }
+        next_id_ = max_id + 1;
+        for (Database* s : shards_) s->set_id_sequence(&next_id_);
+    }
+    for (auto& db : dbs_) executors_.push_back(std::make_unique<DbExecutor>(*db, max_batch, max_delay));
+    catalog_writer_ = executors_[0].get();
+    for (std::size_t i = sharded() ? 1 : 0; i < executors_.size(); ++i) writers_.push_back(executors_[i].get());
+}
+
+std::size_t Storage::shard_index(const std::string& user, std::size_t shards) {
+    uint64_t h = 1469598103934665603ull;
+    for (unsigned char c : user) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return static_cast<std::size_t>(h % shards);
+}
+
+std::string Storage::shard_path(const std::string& path, std::size_t index) {
+    std::string suffix = ".shard" + std::to_string(index);
+    if (path.size() > 3 && path.compare(path.size() - 3, 3, ".db") == 0) return path.substr(0, path.size() - 3) + suffix + ".db";
+    return path + suffix;
+}
+
+std::string Storage::file_name(std::size_t i) const {
+    if (!sharded()) return "main";
+    return i == 0 ? "catalog" : "shard" + std::to_string(i - 1);
+}
+
+std::vector<MessageRecord> Storage::get_history(const std::string& user, sqlite3_int64 before_id, int limit) {
+    std::size_t own = shard_of(user);
+    std::vector<MessageRecord> page = shards_[own]->get_history(user, before_id, limit);
+    if (!sharded()) return page;
+    // Id pochodzą z jednej sekwencji, więc porządek po id jest wspólny dla shardów.
+    // Każdy shard daje najwyżej limit wierszy, a strona to limit najnowszych z sumy.
+    for (std::size_t i = 0; i < shards_.size(); ++i) {
+        if (i == own) continue;
+        auto sent = shards_[i]->get_sent(user, before_id, limit);
+        std::move(sent.begin(), sent.end(), std::back_inserter(page));
+    }
+    std::sort(page.begin(), page.end(), [](const MessageRecord& a, const MessageRecord& b) { return a.id < b.id; });
+    if (page.size() > static_cast<std::size_t>(limit)) page.erase(page.begin(), page.end() - limit);
+    return page;
+}
+
+std::vector<SearchHit> Storage::search(const std::string& user, const std::string& query, int offset, int limit) {
+    std::size_t own = shard_of(user);
+    auto groups = catalog_->get_user_groups(user);
+    if (!sharded()) return shards_[own]->search(user, groups, query, limit, offset);
+    // Każdy shard oddaje swoje offset + limit najlepszych, więc wynik jest wśród nich.
+    // bm25 liczy statystyki słów per plik - przy równym podziale użytkowników oceny
+    // z różnych shardów są porównywalne w przybliżeniu, nie dokładnie.
+    std::vector<SearchHit> hits;
+    for (std::size_t i = 0; i < shards_.size(); ++i) {
+        auto part = shards_[i]->search(user, i == own ? groups : std::vector<std::string>(), query, offset + limit, 0);
+        std::move(part.begin(), part.end(), std::back_inserter(hits));
+    }
+    std::sort(hits.begin(), hits.end(), [](const SearchHit& a, const SearchHit& b) {
+        return a.rank != b.rank ? a.rank < b.rank : a.message.id > b.message.id;
+    });
+    if (hits.size() <= static_cast<std::size_t>(offset)) return {};
+    hits.erase(hits.begin(), hits.begin() + offset);
+    if (hits.size() > static_cast<std::size_t>(limit)) hits.resize(static_cast<std::size_t>(limit));
+    return hits;
+}
+
+// Wysłane bezpośrednie leżą w shardach odbiorców, więc liczniki nadawcy są
+// rozproszone; odebrane i grupowe są tylko w jego własnym shardzie.
+std::string Storage::get_stats(const std::string& username) {
+    if (!sharded()) return shards_[0]->get_stats(username);
+    if (!catalog_->get_user(username)) return format_stats(std::nullopt);
+    UserStats total;
+    for (Database* s : shards_) {
+        auto part = s->get_user_stats(username);
+        if (!part) continue;
+        total.sent += part->sent;
+        total.received += part->received;
+        total.group += part->group;
+        total.last_sent = std::max(total.last_sent, part->last_sent);
+    }
+    return format_stats(total);
+}
+
+// Stan jednego wysłania do grupy, wspólny dla zapisów we wszystkich shardach.
+struct Storage::GroupWrite {
+    std::string from, group, content;
+    sqlite3_int64 group_id = 0;
+    std::size_t origin = 0;
+    std::vector<std::vector<std::string>> recipients; // per shard
+    std::vector<sqlite3_int64> ids;
+    std::atomic<std::size_t> pending{0};
+    std::function<void(std::vector<sqlite3_int64>, bool)> done;
+};
+
+void Storage::save_group_message(const std::string& from, const std::string& group, const GroupRecord& rec,
+                                 const std::string& content, std::function<void(std::vector<sqlite3_int64>, bool)> done) {
+    if (!sharded()) {
+        // jeden plik: członkowie brani w tej samej transakcji co zapis
+        auto id = std::make_shared<sqlite3_int64>(0);
+        writers_[0]->submit([from, group, content, id](Database& db) { return (*id = db.save_group_message(from, group, content)) != 0; },
+                            [id, done = std::move(done)](bool ok) { done({ok ? *id : 0}, ok); });
+        return;
+    }
+    auto w = std::make_shared<GroupWrite>();
+    w->from = from;
+    w->group = group;
+    w->content = content;
+    w->group_id = rec.id;
+    w->origin = shard_of(from);
+    w->recipients.resize(shards_.size());
+    for (const auto& m : rec.members) {
+        if (m != from) w->recipients[shard_of(m)].push_back(m);
+    }
+    w->ids.assign(shards_.size(), 0);
+    w->done = std::move(done);
+    std::vector<std::size_t> targets;
+    for (std::size_t i = 0; i < shards_.size(); ++i) {
+        if (i == w->origin || !w->recipients[i].empty()) targets.push_back(i);
+    }
+    w->pending = targets.size();
+    // pojedyncza nieudana partia (np. SQLITE_BUSY przy COMMIT) nie gubi kopii
+    for (std::size_t i : targets) write_group_shard(w, i, 2);
+}
+
+void Storage::write_group_shard(std::shared_ptr<GroupWrite> w, std::size_t shard, int attempts_left) {
+    writers_[shard]->submit(
+        [w, shard](Database& db) {
+            return (w->ids[shard] = db.save_group_message(w->from, w->group_id, w->group, w->content, w->recipients[shard], shard != w->origin)) != 0;
+        },
+        [this, w, shard, attempts_left](bool ok) {
+            if (!ok) {
+                w->ids[shard] = 0;
+                if (attempts_left > 1) { write_group_shard(w, shard, attempts_left - 1); return; }
+            }
+            if (w->pending.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+            bool complete = true;
+            for (std::size_t i = 0; i < w->ids.size(); ++i) {
+                if (!w->ids[i] && (i == w->origin || !w->recipients[i].empty())) complete = false;
+            }
+            w->done(std::move(w->ids), complete);
+        });
+}
+
+void Storage::rebuild_stats() {
+    for (Database* s : shards_) s->rebuild_stats();
+}
+
+std::vector<std::string> Storage::check_query_plans() {
+    std::vector<std::string> scans;
+    for (auto& db : dbs_) {
+        auto s = db->check_query_plans();
+        scans.insert(scans.end(), s.begin(), s.end());
+    }
+    return scans;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Database.hpp"
+#include "DbExecutor.hpp"
+
+// Magazyn danych serwera. Domyślnie jeden plik (--db) z jednym DbExecutorem.
+// Z --shards N wiadomości i stan dostarczenia leżą w N plikach wybieranych po
+// haszu odbiorcy, a użytkownicy i grupy w katalogu (plik z --db). Każdy plik ma
+// własne połączenie zapisujące i własny DbExecutor, więc zapisy do różnych
+// shardów nie czekają na jedną blokadę SQLite. Odczyty obejmujące kilka shardów
+// (historia wysłanych, statystyki) są składane tutaj.
+class Storage {
+public:
+    Storage(const std::string& path, std::size_t shards, const DatabaseOptions& opts,
+            std::size_t max_batch, std::chrono::microseconds max_delay);
+    Storage(const Storage&) = delete;
+    Storage& operator=(const Storage&) = delete;
+
+    // FNV-1a: stabilne między uruchomieniami i platformami (także dla chat_reshard)
+    static std::size_t shard_index(const std::string& user, std::size_t shards);
+    // chat.db -> chat.shard0.db
+    static std::string shard_path(const std::string& path, std::size_t index);
+
+    bool sharded() const { return shards_.size() > 1; }
+    std::size_t shard_count() const { return shards_.size(); }
+    std::size_t shard_of(const std::string& user) const { return shard_index(user, shards_.size()); }
+
+    Database& catalog() { return *catalog_; }
+    DbExecutor& catalog_writer() { return *catalog_writer_; }
+    Database& shard(std::size_t i) { return *shards_[i]; }
+    DbExecutor& writer(std::size_t i) { return *writers_[i]; }
+    DbExecutor& writer_for(const std::string& user) { return writer(shard_of(user)); }
+
+    std::optional<UserRecord> get_user(const std::string& username) { return catalog_->get_user(username); }
+    std::vector<std::string> get_group_members(const std::string& group) { return catalog_->get_group_members(group); }
+    std::optional<GroupRecord> get_group(const std::string& group) { return catalog_->get_group(group); }
+    std::vector<MessageRecord> get_undelivered(const std::string& user, sqlite3_int64 after_id, int limit) {
+        return shard(shard_of(user)).get_undelivered(user, after_id, limit);
+    }
+    // własny shard w całości + wysłane ze wszystkich pozostałych, scalone po id
+    std::vector<MessageRecord> get_history(const std::string& user, sqlite3_int64 before_id, int limit);
+    std::string get_stats(const std::string& username);
+    // Strona wyników [offset, offset + limit): własny shard z grupami user, pozostałe
+    // tylko z jego wysłanymi; scalone po rank.
+    std::vector<SearchHit> search(const std::string& user, const std::string& query, int offset, int limit);
+
+    // Oryginał w shardzie nadawcy, kopie w shardach pozostałych odbiorców; zapis,
+    // który nie przeszedł, jest raz ponawiany. done(ids, complete) po zatwierdzeniu
+    // wszystkich zapisów, z wątku ostatniego executora: ids[i] = id w shardzie i,
+    // 0 = brak zapisu; complete = oryginał i wszystkie potrzebne kopie zapisane.
+    void save_group_message(const std::string& from, const std::string& group, const GroupRecord& rec,
+                            const std::string& content, std::function<void(std::vector<sqlite3_int64>, bool complete)> done);
+
+    void rebuild_stats();
+    std::vector<std::string> check_query_plans();
+
+    // wszystkie pliki z ich writerami (metryki): "main" albo "catalog", "shard0", ...
+    std::size_t file_count() const { return dbs_.size(); }
+    Database& file(std::size_t i) { return *dbs_[i]; }
+    DbExecutor& file_writer(std::size_t i) { return *executors_[i]; }
+    std::string file_name(std::size_t i) const;
+
+private:
+    struct GroupWrite;
+    void write_group_shard(std::shared_ptr<GroupWrite> w, std::size_t shard, int attempts_left);
+
+    std::vector<std::unique_ptr<Database>> dbs_; // [0] = katalog, dalej shardy
+    Database* catalog_ = nullptr;
+    std::vector<Database*> shards_;              // bez shardów: sam katalog
+    std::atomic<sqlite3_int64> next_id_{1};
+    std::vector<std::unique_ptr<DbExecutor>> executors_; // po dbs_, więc kończą pracę przed zamknięciem baz
+    DbExecutor* catalog_writer_ = nullptr;
+    std::vector<DbExecutor*> writers_;
+};
@@ -2,6 +2,8 @@
 #include <iostream>
 #include <unistd.h>
 #include <fstream>
+#include <thread>
+#include <vector>
 #include "net/TcpServer.hpp"
 #pragma clang diagnostic ignored "-Wdeprecated-declarations"
 
@@ -12,14 +14,43 @@ void daemonize() {
     std::cerr.rdbuf(log.rdbuf());
 }
 
-int main() {
+// --check-plans: migruje bazę i sprawdza, czy gorące zapytania idą po indeksach
+static int check_plans(const ServerConfig& cfg) {
+    Storage db(cfg.db_path, cfg.db_shards, cfg.db, cfg.db_batch, std::chrono::microseconds(cfg.db_linger_us));
+    auto scans = db.check_query_plans();
+    for (const auto& s : scans) std::cerr << "Full scan: " << s << "\n";
+    std::cout << (scans.empty() ? "All hot queries use indexes\n" : "Query plan check failed\n");
+    return scans.empty() ? 0 : 1;
+}
+
+// --rebuild-stats: przelicza liczniki user_stats i kończy
+static int rebuild_stats(const ServerConfig& cfg) {
+    Storage db(cfg.db_path, cfg.db_shards, cfg.db, cfg.db_batch, std::chrono::microseconds(cfg.db_linger_us));
+    db.rebuild_stats();
+    std::cout << "User stats rebuilt\n";
+    return 0;
+}
+
+int main(int argc, char** argv) {
     try {
+        ServerConfig cfg = parse_args(argc, argv);
+        if (cfg.check_plans) return check_plans(cfg);
+        if (cfg.rebuild_stats) return rebuild_stats(cfg);
         // daemonize(); 
-        boost::asio::io_context io;
-        TcpServer server(io, 5555);
-        std::cout << "Server started on port 5555\n";
+        boost::asio::io_context io(static_cast<int>(cfg.io_threads));
+        TcpServer server(io, cfg);
+#if defined(BOOST_ASIO_HAS_IO_URING_AS_DEFAULT)
+        const char* backend = "io_uring";
+#else
+        const char* backend = "epoll";
+#endif
+        std::cout << "Server started on port " << cfg.port << " (" << cfg.io_threads << " threads, " << backend << ")\n";
+        std::vector<std::thread> workers;
+        for (std::size_t i = 1; i < cfg.io_threads; ++i) workers.emplace_back([&io]() { io.run(); });
         io.run();
+        for (auto& t : workers) t.join();
     } catch (std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
+        return 1;
     }
 }
@@ -0,0 +1,57 @@
+#include "AdminServer.hpp"
+#include <memory>
+
+using boost::asio::ip::tcp;
+
+namespace {
+
+class AdminConnection : public std::enable_shared_from_this<AdminConnection> {
+public:
+    AdminConnection(tcp::socket socket, const AdminServer::Render& render)
+        : socket_(std::move(socket)), render_(render), request_(8192) {}
+
+    void start() {
+        auto self = shared_from_this();
+        boost::asio::async_read_until(socket_, request_, "\r\n\r\n", [this, self](boost::system::error_code ec, std::size_t) {
+            if (ec) return;
+            std::istream in(&request_);
+            std::string method, target;
+            in >> method >> target;
+            if (method == "GET" && (target == "/metrics" || target.rfind("/metrics?", 0) == 0)) {
+                respond("200 OK", "text/plain; version=0.0.4; charset=utf-8", render_());
+            } else {
+                respond("404 Not Found", "text/plain", "not found\n");
+            }
+        });
+    }
+
+private:
+    void respond(const char* status, const char* type, const std::string& body) {
+        response_ = std::string("HTTP/1.1 ") + status + "\r\nContent-Type: " + type +
+                    "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        auto self = shared_from_this();
+        boost::asio::async_write(socket_, boost::asio::buffer(response_), [this, self](boost::system::error_code, std::size_t) {
+            boost::system::error_code ignored;
+            socket_.shutdown(tcp::socket::shutdown_both, ignored);
+        });
+    }
+
+    tcp::socket socket_;
+    const AdminServer::Render& render_;
+    boost::asio::streambuf request_;
+    std::string response_;
+};
+
+} // namespace
+
+AdminServer::AdminServer(boost::asio::io_context& io, const tcp::endpoint& endpoint, Render render)
+    : io_(io), acceptor_(io, endpoint), render_(std::move(render)) {
+    accept();
+}
+
+void AdminServer::accept() {
+    acceptor_.async_accept(boost::asio::make_strand(io_), [this](boost::system::error_code ec, tcp::socket socket) {
+        if (!ec) std::make_shared<AdminConnection>(std::move(socket), render_)->start();
+        accept();
+    });
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <functional>
+#include <string>
+
+// Minimalny serwer HTTP na porcie administracyjnym: GET /metrics zwraca metryki
+// w formacie tekstowym Prometheusa, reszta 404. Jedno żądanie na połączenie.
+class AdminServer {
+public:
+    using Render = std::function<std::string()>;
+
+    AdminServer(boost::asio::io_context& io, const boost::asio::ip::tcp::endpoint& endpoint, Render render);
+
+private:
+    void accept();
+
+    boost::asio::io_context& io_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    Render render_;
+};
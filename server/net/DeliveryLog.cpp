@@ -0,0 +1,39 @@
+#include "DeliveryLog.hpp"
+#include <algorithm>
+
+void DeliveryLog::reset() {
+    streaming_ = true;
+    cursor_ = 0;
+    live_.clear();
+    sent_.clear();
+}
+
+bool DeliveryLog::backlog_message(sqlite3_int64 id) {
+    cursor_ = std::max(cursor_, id);
+    live_.erase(live_.begin(), live_.lower_bound(cursor_));
+    return live_.erase(id) == 0;
+}
+
+void DeliveryLog::backlog_done() {
+    streaming_ = false;
+    live_.clear();
+}
+
+bool DeliveryLog::live_message(sqlite3_int64 id) {
+    if (id <= cursor_ || live_.count(id)) return false;
+    if (streaming_) live_.insert(id);
+    return true;
+}
+
+std::vector<sqlite3_int64> DeliveryLog::ack(sqlite3_int64 id) {
+    auto it = std::find(sent_.begin(), sent_.end(), id);
+    if (it == sent_.end()) return {};
+    return take(static_cast<std::size_t>(it - sent_.begin()) + 1);
+}
+
+std::vector<sqlite3_int64> DeliveryLog::take(std::size_t count) {
+    auto end = sent_.begin() + static_cast<std::ptrdiff_t>(std::min(count, sent_.size()));
+    std::vector<sqlite3_int64> ids(sent_.begin(), end);
+    sent_.erase(sent_.begin(), end);
+    return ids;
+}
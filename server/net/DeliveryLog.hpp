@@ -0,0 +1,47 @@
+#pragma once
+#include <sqlite3.h>
+#include <cstddef>
+#include <deque>
+#include <set>
+#include <vector>
+
+// Księgowanie dostarczeń jednej sesji, bez I/O (wszystko na strandzie sesji).
+//
+// Zaległe idą z bazy rosnąco po id, a wiadomości na żywo od różnych nadawców
+// i writerów shardów w dowolnej kolejności, także przeplatane z zaległymi.
+// Dlatego:
+//  - strumień zaległych idzie do końca i pomija to, co już poszło na żywo;
+//  - na żywo pomijamy to, co strumień już wysłał (id <= kursor);
+//  - Ack X oznacza dokładnie ramki zapisane do ramki z X włącznie: klient ją
+//    widział i wszystko przed nią, ale nie późniejsze ramki o mniejszych id.
+// Zapisy jednego użytkownika idą przez jeden writer, więc w jego shardzie id
+// rosną w kolejności commitów - odczyt zaległych widzi wszystkie niedostarczone
+// o id mniejszym niż największe, które zwrócił.
+class DeliveryLog {
+public:
+    // nowe logowanie: strumień zaległych od początku, niepotwierdzone przepadają
+    // (zostają niedostarczone w bazie)
+    void reset();
+    bool streaming() const { return streaming_; }
+    // kolejna porcja zaległych zaczyna się za tym id
+    sqlite3_int64 cursor() const { return cursor_; }
+    // false = pomiń, bo poszła już na żywo; kursor przesuwa się w obu przypadkach
+    bool backlog_message(sqlite3_int64 id);
+    void backlog_done();
+    // false = duplikat, strumień zaległych już ją wysłał
+    bool live_message(sqlite3_int64 id);
+
+    // ramka z wiadomością poszła na drut (kolejność zapisu)
+    void written(sqlite3_int64 id) { sent_.push_back(id); }
+    // id do oznaczenia po Ack; puste, gdy id nie czeka na potwierdzenie
+    std::vector<sqlite3_int64> ack(sqlite3_int64 id);
+    // pierwsze count zapisanych (klient bez Ack: zapis zakończony)
+    std::vector<sqlite3_int64> take(std::size_t count);
+    std::size_t unacked() const { return sent_.size(); }
+
+private:
+    bool streaming_ = false;
+    sqlite3_int64 cursor_ = 0;         // w kolejce są już wszystkie zaległe o id <= cursor
+    std::set<sqlite3_int64> live_;     // wysłane na żywo powyżej kursora, póki strumień trwa
+    std::deque<sqlite3_int64> sent_;   // zapisane, jeszcze nieoznaczone w bazie
+};
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Gotowa ramka (4 bajty długości + treść), niemodyfikowalna i współdzielona.
+// Przy rozsyłaniu do wielu odbiorców serializujemy raz, a kolejki sesji
+// trzymają tylko referencję do tego samego bufora.
+using Frame = std::shared_ptr<const std::vector<char>>;
+
+inline Frame make_frame(const std::string& payload) {
+    auto buf = std::make_shared<std::vector<char>>(4 + payload.size());
+    uint32_t len = htonl(static_cast<uint32_t>(payload.size()));
+    std::memcpy(buf->data(), &len, 4);
+    std::memcpy(buf->data() + 4, payload.data(), payload.size());
+    return buf;
+}
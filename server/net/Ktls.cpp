@@ -0,0 +1,194 @@
+#include "Ktls.hpp"
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+
+#ifdef __linux__
+#include <linux/tls.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#endif
+
+namespace ktls {
+namespace {
+
+// Zbierane w trakcie handshake'u, żyją do enable() albo do SSL_free.
+struct State {
+    std::vector<unsigned char> client_secret; // CLIENT_TRAFFIC_SECRET_0
+    std::vector<unsigned char> server_secret; // SERVER_TRAFFIC_SECRET_0
+    bool counting = false;
+    uint64_t tx_records = 0; // rekordy wysłane kluczem aplikacyjnym (bilety sesji)
+
+    ~State() {
+        OPENSSL_cleanse(client_secret.data(), client_secret.size());
+        OPENSSL_cleanse(server_secret.data(), server_secret.size());
+    }
+};
+
+void free_state(void*, void* ptr, CRYPTO_EX_DATA*, int, long, void*) {
+    delete static_cast<State*>(ptr);
+}
+
+int index() {
+    static const int idx = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, free_state);
+    return idx;
+}
+
+std::vector<unsigned char> from_hex(const char* s, std::size_t len) {
+    auto nibble = [](char c) { return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10; };
+    std::vector<unsigned char> out(len / 2);
+    for (std::size_t i = 0; i < out.size(); ++i) out[i] = static_cast<unsigned char>(nibble(s[2 * i]) << 4 | nibble(s[2 * i + 1]));
+    return out;
+}
+
+// linia keylogu: "<ETYKIETA> <client_random hex> <sekret hex>"
+void on_keylog(const SSL* ssl, const char* line) {
+    auto* st = static_cast<State*>(SSL_get_ex_data(ssl, index()));
+    if (!st) return;
+    const char* random = std::strchr(line, ' ');
+    const char* secret = random ? std::strchr(random + 1, ' ') : nullptr;
+    if (!secret) return;
+    std::string label(line, random);
+    if (label == "CLIENT_TRAFFIC_SECRET_0") st->client_secret = from_hex(secret + 1, std::strlen(secret + 1));
+    else if (label == "SERVER_TRAFFIC_SECRET_0") st->server_secret = from_hex(secret + 1, std::strlen(secret + 1));
+}
+
+// Numer sekwencyjny wysyłki: rekordy zapisane po naszym Finished (czyli bilety
+// NewSessionTicket) poszły już kluczem aplikacyjnym. Nagłówek rekordu Finished
+// jest raportowany przed samą wiadomością, więc nie wpada do licznika.
+void on_msg(int write_p, int, int content_type, const void* buf, std::size_t len, SSL*, void* arg) {
+    auto* st = static_cast<State*>(arg);
+    if (!write_p) return;
+    if (content_type == SSL3_RT_HANDSHAKE && len > 0 && static_cast<const unsigned char*>(buf)[0] == SSL3_MT_FINISHED) st->counting = true;
+    else if (content_type == SSL3_RT_HEADER && st->counting) ++st->tx_records;
+}
+
+#ifdef __linux__
+// HKDF-Expand-Label z RFC 8446 z pustym kontekstem
+bool expand_label(const EVP_MD* md, const std::vector<unsigned char>& secret, const char* label, unsigned char* out, std::size_t len) {
+    std::string full = std::string("tls13 ") + label;
+    std::vector<unsigned char> info = {static_cast<unsigned char>(len >> 8), static_cast<unsigned char>(len), static_cast<unsigned char>(full.size())};
+    info.insert(info.end(), full.begin(), full.end());
+    info.push_back(0);
+    EVP_PKEY_CTX* pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+    bool ok = pctx && EVP_PKEY_derive_init(pctx) > 0 &&
+              EVP_PKEY_CTX_set_hkdf_mode(pctx, EVP_PKEY_HKDEF_MODE_EXPAND_ONLY) > 0 &&
+              EVP_PKEY_CTX_set_hkdf_md(pctx, md) > 0 &&
+              EVP_PKEY_CTX_set1_hkdf_key(pctx, secret.data(), static_cast<int>(secret.size())) > 0 &&
+              EVP_PKEY_CTX_add1_hkdf_info(pctx, info.data(), static_cast<int>(info.size())) > 0 &&
+              EVP_PKEY_derive(pctx, out, &len) > 0;
+    EVP_PKEY_CTX_free(pctx);
+    return ok;
+}
+
+// W TLS 1.3 salt to pierwsze bajty IV, a iv w strukturze jądra - reszta.
+template <typename Info>
+bool install(int fd, int direction, uint16_t cipher_type, const EVP_MD* md, const std::vector<unsigned char>& secret, uint64_t seq) {
+    Info info{};
+    unsigned char iv[12];
+    bool ok = expand_label(md, secret, "key", info.key, sizeof(info.key)) && expand_label(md, secret, "iv", iv, sizeof(iv));
+    if (ok) {
+        info.info.version = TLS_1_3_VERSION;
+        info.info.cipher_type = cipher_type;
+        std::memcpy(info.salt, iv, sizeof(info.salt));
+        std::memcpy(info.iv, iv + sizeof(info.salt), sizeof(info.iv));
+        for (std::size_t i = 0; i < sizeof(info.rec_seq); ++i) info.rec_seq[sizeof(info.rec_seq) - 1 - i] = static_cast<unsigned char>(seq >> (8 * i));
+        ok = setsockopt(fd, SOL_TLS, direction, &info, sizeof(info)) == 0;
+    }
+    OPENSSL_cleanse(&info, sizeof(info));
+    OPENSSL_cleanse(iv, sizeof(iv));
+    return ok;
+}
+
+bool supported(uint32_t cipher_id) {
+    switch (cipher_id) {
+    case TLS1_3_CK_AES_128_GCM_SHA256:
+    case TLS1_3_CK_AES_256_GCM_SHA384:
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    case TLS1_3_CK_CHACHA20_POLY1305_SHA256:
+#endif
+        return true;
+    }
+    return false;
+}
+
+bool install(int fd, int direction, uint32_t cipher_id, const EVP_MD* md, const std::vector<unsigned char>& secret, uint64_t seq) {
+    switch (cipher_id) {
+    case TLS1_3_CK_AES_128_GCM_SHA256:
+        return install<tls12_crypto_info_aes_gcm_128>(fd, direction, TLS_CIPHER_AES_GCM_128, md, secret, seq);
+    case TLS1_3_CK_AES_256_GCM_SHA384:
+        return install<tls12_crypto_info_aes_gcm_256>(fd, direction, TLS_CIPHER_AES_GCM_256, md, secret, seq);
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    case TLS1_3_CK_CHACHA20_POLY1305_SHA256:
+        return install<tls12_crypto_info_chacha20_poly1305>(fd, direction, TLS_CIPHER_CHACHA20_POLY1305, md, secret, seq);
+#endif
+    }
+    return false;
+}
+#endif
+
+} // namespace
+
+const char* status_name(Status s) {
+    switch (s) {
+    case Offloaded: return "offloaded";
+    case ReceiveOnly: return "receive_only";
+    case NoKernelSupport: return "no_kernel_support";
+    case Unsupported: return "unsupported";
+    case BufferedData: return "buffered_data";
+    case Count: break;
+    }
+    return "";
+}
+
+void prepare_context(SSL_CTX* ctx) {
+    SSL_CTX_set_keylog_callback(ctx, on_keylog);
+}
+
+void prepare(SSL* ssl) {
+    auto* st = new State;
+    SSL_set_ex_data(ssl, index(), st);
+    SSL_set_msg_callback(ssl, on_msg);
+    SSL_set_msg_callback_arg(ssl, st);
+}
+
+Status enable(SSL* ssl, int fd) {
+    std::unique_ptr<State> st(static_cast<State*>(SSL_get_ex_data(ssl, index())));
+    SSL_set_ex_data(ssl, index(), nullptr);
+    SSL_set_msg_callback(ssl, nullptr);
+    if (!st) return Unsupported;
+#ifdef __linux__
+    const SSL_CIPHER* cipher = SSL_get_current_cipher(ssl);
+    if (SSL_version(ssl) != TLS1_3_VERSION || !cipher || !supported(SSL_CIPHER_get_id(cipher)) ||
+        st->client_secret.empty() || st->server_secret.empty()) return Unsupported;
+    // Jądro musi zacząć od granicy rekordu. Dane, które OpenSSL już wciągnął albo
+    // ma jeszcze do wysłania, przepadłyby, więc taka sesja zostaje w przestrzeni użytkownika.
+    if (SSL_has_pending(ssl) || BIO_ctrl_pending(SSL_get_rbio(ssl)) || BIO_wpending(SSL_get_wbio(ssl))) return BufferedData;
+    if (setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0) return NoKernelSupport;
+    uint32_t id = SSL_CIPHER_get_id(cipher);
+    const EVP_MD* md = SSL_CIPHER_get_handshake_digest(cipher);
+    // Odbiór najpierw: bez TLS_RX gniazdo z samym ULP działa jak zwykłe, a po
+    // nieudanym TLS_TX sesja nadal spójnie wysyła przez OpenSSL. Klient nie wysłał
+    // jeszcze żadnego rekordu aplikacyjnego, więc odbiór zaczyna od zera.
+    if (!install(fd, TLS_RX, id, md, st->client_secret, 0)) return NoKernelSupport;
+    if (!install(fd, TLS_TX, id, md, st->server_secret, st->tx_records)) return ReceiveOnly;
+    return Offloaded;
+#else
+    (void)fd;
+    return NoKernelSupport;
+#endif
+}
+
+} // namespace ktls
@@ -0,0 +1,29 @@
+#pragma once
+#include <openssl/ssl.h>
+
+// Kernel TLS (Linux): po handshake'u klucze TLS 1.3 trafiają do jądra, a sesja czyta
+// i pisze zwykłym gniazdem - szyfrowanie rekordów znika z wątku reaktora.
+// boost::asio::ssl::stream prowadzi OpenSSL przez parę BIO w pamięci, więc
+// SSL_OP_ENABLE_KTLS nic tu nie da; sekrety zbieramy z keylogu i sami ustawiamy
+// TLS_TX/TLS_RX. W każdym nieobsłużonym przypadku sesja zostaje na ssl::stream.
+namespace ktls {
+
+enum Status {
+    Offloaded,      // odbiór i wysyłka w jądrze
+    ReceiveOnly,    // jądro bez TLS_TX; wysyłka dalej przez OpenSSL
+    NoKernelSupport, // brak modułu tls albo szyfru w jądrze
+    Unsupported,    // TLS 1.2 albo szyfr inny niż AES-GCM / ChaCha20-Poly1305
+    BufferedData,   // OpenSSL ma już w buforach bajty po handshake'u
+    Count
+};
+const char* status_name(Status s);
+
+// na kontekście serwera, przed pierwszym połączeniem
+void prepare_context(SSL_CTX* ctx);
+// na każdej sesji przed handshake'iem
+void prepare(SSL* ssl);
+
+// po udanym handshake'u; sekrety są czyszczone niezależnie od wyniku
+Status enable(SSL* ssl, int fd);
+
+} // namespace ktls
@@ -0,0 +1,41 @@
+#include "PresenceRegistry.hpp"
+#include <functional>
+
+PresenceRegistry::Shard& PresenceRegistry::shard_for(const std::string& user) {
+    return shards_[std::hash<std::string>{}(user) % kShards];
+}
+
+const PresenceRegistry::Shard& PresenceRegistry::shard_for(const std::string& user) const {
+    return shards_[std::hash<std::string>{}(user) % kShards];
+}
+
+void PresenceRegistry::add(const std::string& user, std::weak_ptr<Session> session) {
+    auto& shard = shard_for(user);
+    std::lock_guard<std::mutex> lock(shard.mu);
+    shard.sessions[user] = std::move(session);
+}
+
+void PresenceRegistry::remove(const std::string& user, const std::weak_ptr<Session>& session) {
+    auto& shard = shard_for(user);
+    std::lock_guard<std::mutex> lock(shard.mu);
+    auto it = shard.sessions.find(user);
+    if (it == shard.sessions.end()) return;
+    bool same = !it->second.owner_before(session) && !session.owner_before(it->second);
+    if (same || it->second.expired()) shard.sessions.erase(it);
+}
+
+std::weak_ptr<Session> PresenceRegistry::find(const std::string& user) const {
+    const auto& shard = shard_for(user);
+    std::lock_guard<std::mutex> lock(shard.mu);
+    auto it = shard.sessions.find(user);
+    return it == shard.sessions.end() ? std::weak_ptr<Session>() : it->second;
+}
+
+std::size_t PresenceRegistry::size() const {
+    std::size_t n = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mu);
+        n += shard.sessions.size();
+    }
+    return n;
+}
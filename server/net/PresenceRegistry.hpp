@@ -0,0 +1,34 @@
+#pragma once
+#include <array>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class Session;
+
+// Zalogowani użytkownicy -> ich sesje. Mapa podzielona na shardy z osobnymi
+// mutexami, żeby wątki io_context nie rywalizowały o jeden lock przy dostarczaniu.
+// Na zewnątrz wychodzą tylko weak_ptr: sesja może się zamknąć na innym rdzeniu
+// w trakcie dostarczania, więc odbiorca musi zrobić lock() przed użyciem.
+class PresenceRegistry {
+public:
+    void add(const std::string& user, std::weak_ptr<Session> session);
+    // Usuwa wpis tylko jeśli nadal wskazuje na tę sesję (nowsze logowanie zostaje).
+    void remove(const std::string& user, const std::weak_ptr<Session>& session);
+    std::weak_ptr<Session> find(const std::string& user) const;
+    std::size_t size() const;
+
+private:
+    static constexpr std::size_t kShards = 16;
+
+    struct Shard {
+        mutable std::mutex mu;
+        std::unordered_map<std::string, std::weak_ptr<Session>> sessions;
+    };
+
+    Shard& shard_for(const std::string& user);
+    const Shard& shard_for(const std::string& user) const;
+
+    std::array<Shard, kShards> shards_;
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "../Config.hpp"
+#include "../auth/PasswordHasher.hpp"
+#include "../db/Storage.hpp"
+#include "../util/BufferPool.hpp"
+#include "../util/RateLimiter.hpp"
+#include "../util/TimerWheel.hpp"
+#include "../util/WorkerPool.hpp"
+#include "PresenceRegistry.hpp"
+#include "ServerMetrics.hpp"
+
+// Limity żądań; przekroczenie kończy się tanim błędem "rate limited" bez dotykania bazy.
+struct RateLimits {
+    RateLimiter user; // żądania zalogowanego użytkownika, łącznie ze wszystkich jego sesji
+    RateLimiter ip;   // wszystkie żądania z adresu, także przed zalogowaniem
+    RateLimiter auth; // login i register z adresu: osobny, mniejszy budżet (PBKDF2)
+};
+
+// Usługi współdzielone przez wszystkie sesje; własność ma TcpServer.
+struct ServerContext {
+    const ServerConfig& cfg;
+    Storage& storage; // katalog + shardy wiadomości, każdy plik z własnym writerem
+    WorkerPool& db_reads; // odczyty z bazy poza wątkami I/O
+    PresenceRegistry& presence;
+    PasswordHasher& hasher;
+    ServerMetrics& metrics;
+    BufferPool& buffers; // bufory ramek (odczyt żądań i sklejane zapisy)
+    TimerWheel& timers;  // terminy handshake'u, heartbeat i idle wszystkich sesji
+    RateLimits& limits;
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include <array>
+
+#include "../util/Metrics.hpp"
+#include "Ktls.hpp"
+
+// Metryki warstwy sieciowej, wspólne dla wszystkich sesji (ServerContext).
+struct ServerMetrics {
+    struct Request {
+        Counter total;
+        Counter errors;
+        LatencyHistogram latency; // od odebrania treści do wstawienia odpowiedzi do kolejki
+    };
+    // indeks = opcode żądania (proto::Op < 0x80), 0 = nieznane
+    std::array<Request, 16> requests;
+
+    struct Handshake {
+        Counter total;
+        LatencyHistogram latency;
+    };
+    Handshake tls_full;
+    Handshake tls_resumed; // SSL_session_reused: bilet albo cache sesji
+    Counter tls_handshake_failures;
+    std::array<Counter, ktls::Count> ktls; // wynik próby kTLS po handshake'u (tylko z --ktls)
+    Gauge sessions_active;
+    // suma kolejek wyjściowych wszystkich sesji (ramki czekające, bez bufora w zapisie)
+    Gauge outbox_frames;
+    Gauge outbox_bytes;
+    Counter slow_consumer_disconnects;
+    Counter oversized_frames;
+    Counter handshake_timeouts;
+    Counter idle_timeouts;
+    Counter heartbeats;
+    Counter rate_limited_user;
+    Counter rate_limited_ip;
+    Counter rate_limited_auth;
+    Counter rate_limit_disconnects;
+};
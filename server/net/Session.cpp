@@ -1,151 +1,532 @@
 #include "Session.hpp"
 #include <boost/asio.hpp>
+#include <algorithm>
 #include <cstring>
-#include <nlohmann/json.hpp>
-#include <openssl/crypto.h>
-#include <openssl/evp.h>
-#include <openssl/rand.h>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/ssl.h>
+#include <sys/socket.h>
 
 using boost::asio::ip::tcp;
-using json = nlohmann::json;
 namespace ssl = boost::asio::ssl;
 
-std::unordered_map<std::string, Session*> Session::active_sessions_;
-
-static std::vector<unsigned char> random_bytes(std::size_t n) {
-    std::vector<unsigned char> out(n);
-    RAND_bytes(out.data(), static_cast<int>(out.size()));
-    return out;
-}
-
-static std::vector<unsigned char> pbkdf2_sha256(const std::string& password, const std::vector<unsigned char>& salt, int iterations = 120000, std::size_t dk_len = 32) {
-    std::vector<unsigned char> out(dk_len);
-    PKCS5_PBKDF2_HMAC(password.c_str(), static_cast<int>(password.size()), salt.data(), static_cast<int>(salt.size()), iterations, EVP_sha256(), static_cast<int>(dk_len), out.data());
-    return out;
-}
-
-static bool constant_time_equal(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b) {
-    if (a.size() != b.size()) return false;
-    return CRYPTO_memcmp(a.data(), b.data(), a.size()) == 0;
+// socket jest przyjmowany na własnym strandzie, więc wszystkie handlery tej sesji
+// wykonują się sekwencyjnie, nawet gdy io_context obsługuje kilka wątków
+Session::Session(tcp::socket socket, ssl::context& ssl_ctx, ServerContext& ctx)
+    : stream_(std::move(socket), ssl_ctx), cfg_(ctx.cfg), storage_(ctx.storage), db_reads_(ctx.db_reads), buffers_(ctx.buffers), timers_(ctx.timers),
+      presence_(ctx.presence), hasher_(ctx.hasher), metrics_(ctx.metrics), limits_(ctx.limits) {
+    metrics_.sessions_active.add(1);
+    boost::system::error_code ec;
+    auto peer = stream_.lowest_layer().remote_endpoint(ec);
+    if (!ec) peer_ip_ = peer.address().to_string();
+    // Starsze klienty JSON nie odpowiadają na Ping, więc nie zamykamy ich za ciszę;
+    // martwe połączenie wykryje keepalive jądra po mniej więcej tym samym czasie.
+    if (cfg_.idle_timeout_s) {
+        stream_.lowest_layer().set_option(tcp::socket::keep_alive(true), ec);
+        int fd = stream_.lowest_layer().native_handle();
+        int idle = static_cast<int>(cfg_.idle_timeout_s), interval = 10, count = 3;
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+    }
 }
 
-Session::Session(tcp::socket socket, ssl::context& ssl_ctx, Database& db)
-    : stream_(std::move(socket), ssl_ctx), db_(db) {}
-
 void Session::start() {
     auto self = shared_from_this();
+    handshake_started_ = std::chrono::steady_clock::now();
+    // jeden wpis w kole czasowym na sesję: najpierw termin handshake'u, potem heartbeat/idle
+    schedule_check(std::chrono::seconds(cfg_.handshake_timeout_s));
+    if (cfg_.ktls) ktls::prepare(stream_.native_handle());
     stream_.async_handshake(ssl::stream_base::server, [this, self](const boost::system::error_code& ec) { on_handshake(ec); });
 }
 
 void Session::on_handshake(const boost::system::error_code& ec) {
-    if (!ec) read_header();
+    if (ec) { metrics_.tls_handshake_failures.inc(); return; }
+    handshake_done_ = true;
+    last_read_ = std::chrono::steady_clock::now();
+    auto& hs = SSL_session_reused(stream_.native_handle()) ? metrics_.tls_resumed : metrics_.tls_full;
+    hs.total.inc();
+    hs.latency.observe(std::chrono::steady_clock::now() - handshake_started_);
+    // klient, który wynegocjował ALPN chat-bin/1, mówi protokołem binarnym
+    const unsigned char* alpn = nullptr;
+    unsigned int alpn_len = 0;
+    SSL_get0_alpn_selected(stream_.native_handle(), &alpn, &alpn_len);
+    if (alpn && std::string(reinterpret_cast<const char*>(alpn), alpn_len) == proto::kBinaryAlpn) {
+        format_ = proto::Format::Binary;
+        heartbeats_ = true;
+    }
+    if (cfg_.ktls) {
+        auto status = ktls::enable(stream_.native_handle(), stream_.next_layer().native_handle());
+        metrics_.ktls[status].inc();
+        ktls_rx_ = status == ktls::Offloaded || status == ktls::ReceiveOnly;
+        ktls_tx_ = status == ktls::Offloaded;
+    }
+    read_header();
 }
 
 Session::~Session() {
-    if (logged_user_) active_sessions_.erase(*logged_user_);
+    if (logged_user_) presence_.remove(*logged_user_, weak_from_this());
+    metrics_.outbox_frames.add(-static_cast<int64_t>(outbox_.size()));
+    metrics_.outbox_bytes.add(-static_cast<int64_t>(outbox_bytes_));
+    metrics_.sessions_active.add(-1);
+    // Klienci zwykle znikają bez close_notify, a OpenSSL usuwa wtedy sesję z cache.
+    // Bilety i tak zostają ważne, więc sesja w cache też może być wznowiona.
+    SSL* ssl = stream_.native_handle();
+    if (SSL_is_init_finished(ssl)) SSL_set_shutdown(ssl, SSL_get_shutdown(ssl) | SSL_SENT_SHUTDOWN);
 }
 
 void Session::read_header() {
     auto self = shared_from_this();
-    boost::asio::async_read(stream_, boost::asio::buffer(header_), [this, self](boost::system::error_code ec, std::size_t) {
+    transport_read(boost::asio::buffer(header_), [this, self](boost::system::error_code ec, std::size_t) {
         if (!ec) {
+            last_read_ = std::chrono::steady_clock::now();
+            ping_sent_ = false;
             uint32_t length = 0;
             std::memcpy(&length, header_.data(), 4);
             length = ntohl(length);
-            read_body(length);
+            // długość pochodzi od klienta: za duża ramka kończy sesję, zanim cokolwiek zaalokujemy
+            if (length > cfg_.max_frame_bytes) reject_frame(length);
+            else read_body(length);
         }
     });
 }
 
+static proto::Packet ok_packet() {
+    proto::Packet p; p.op = proto::Op::Ok; return p;
+}
+
+static proto::Packet error_packet(const std::string& message) {
+    proto::Packet p; p.op = proto::Op::Error; p.message = message; return p;
+}
+
+static proto::Packet message_packet(sqlite3_int64 id, const std::string& from, const std::string& content, const std::string& ts = "") {
+    proto::Packet p; p.op = proto::Op::Message; p.id = id; p.from = from; p.message = content; p.ts = ts; return p;
+}
+
+void Session::reject_frame(std::size_t length) {
+    metrics_.oversized_frames.inc();
+    std::cerr << "Frame of " << length << " bytes from " << logged_user_.value_or("?") << " exceeds --max-frame, closing\n";
+    close_after_flush_ = true;
+    enqueue(make_frame(proto::encode(error_packet("frame too large"), format_)));
+}
+
 void Session::read_body(std::size_t length) {
     auto self = shared_from_this();
-    body_.resize(length);
-    boost::asio::async_read(stream_, boost::asio::buffer(body_), [this, self](boost::system::error_code ec, std::size_t) {
+    body_ = buffers_.acquire(length);
+    transport_read(boost::asio::buffer(body_.data(), body_.size()), [this, self](boost::system::error_code ec, std::size_t) {
         if (!ec) {
-            std::string text(body_.begin(), body_.end());
-            json response;
-            try {
-                json req = json::parse(text);
-                std::string type = req.value("type", "");
-
-                if (type != "login" && type != "register" && !logged_user_) {
-                    response["type"] = "error"; response["message"] = "not authenticated";
-                }
-                else if (type == "register") {
-                    std::string user = req.value("username", ""), pass = req.value("password", "");
-                    if (user.empty() || pass.empty()) { response["type"] = "error"; response["message"] = "missing fields"; }
-                    else if (db_.get_user(user)) { response["type"] = "error"; response["message"] = "user exists"; }
-                    else {
-                        auto salt = random_bytes(16); auto hash = pbkdf2_sha256(pass, salt);
-                        db_.create_user(user, salt, hash); response["type"] = "ok";
-                    }
-                }
-                else if (type == "login") {
-                    std::string user = req.value("username", ""), pass = req.value("password", "");
-                    auto rec = db_.get_user(user);
-                    if (!rec) { response["type"] = "error"; response["message"] = "no such user"; }
-                    else {
-                        auto computed = pbkdf2_sha256(pass, rec->salt);
-                        if (!constant_time_equal(computed, rec->hash)) { response["type"] = "error"; response["message"] = "wrong password"; }
-                        else {
-                            logged_user_ = user; active_sessions_[user] = this;
-                            auto pending = db_.get_undelivered(user);
-                            for (auto& m : pending) {
-                                json msg; msg["type"] = "message"; msg["from"] = m.from; msg["message"] = m.content; msg["ts"] = m.ts;
-                                std::string out = msg.dump(); std::vector<char> data(out.begin(), out.end()); write_message(data);
+            request_started_ = std::chrono::steady_clock::now();
+            handle_request();
+        }
+    });
+}
+
+void Session::handle_request() {
+    using proto::Op;
+    auto self = shared_from_this();
+    proto::Packet response = error_packet("unknown request");
+    // odczyty, haszowanie i zapisy kończą się asynchronicznie (pule / DbExecutor)
+    bool pending = false;
+    request_op_ = 0;
+    try {
+        // bufor wraca do puli zaraz po zdekodowaniu (koniec zakresu), także przy błędzie
+        BufferPool::Lease body = std::move(body_);
+        proto::Packet req = proto::decode_request(body.data(), body.size(), format_);
+        auto op_index = static_cast<std::size_t>(req.op);
+        request_op_ = op_index < metrics_.requests.size() ? op_index : 0;
+
+        // limity przed jakąkolwiek pracą na bazie i hasherze; Ack i Pong są tanie i zawsze przechodzą
+        if (req.op != Op::Ack && req.op != Op::Pong && !within_limits(req.op)) {
+            if (cfg_.rate_limit_strikes && ++limit_strikes_ >= cfg_.rate_limit_strikes) {
+                metrics_.rate_limit_disconnects.inc();
+                std::cerr << "Disconnecting " << logged_user_.value_or(peer_ip_) << " after " << limit_strikes_ << " rate-limited requests\n";
+                close_after_flush_ = true;
+                enqueue(make_frame(proto::encode(error_packet("rate limited"), format_)));
+                record_request(true);
+                return;
+            }
+            response = error_packet("rate limited");
+        }
+        else if (req.op != Op::Login && req.op != Op::Register && req.op != Op::Pong && !logged_user_) {
+            response = error_packet("not authenticated");
+        }
+        else switch (req.op) {
+        case Op::Register: {
+            std::string user = req.username, pass = req.password;
+            if (user.empty() || pass.empty()) response = error_packet("missing fields");
+            else if (submit_read([user](Storage& db) { return db.get_user(user).has_value(); }, [this, self, user, pass](bool exists) {
+                         if (exists) { finish_request(error_packet("user exists")); return; }
+                         if (!hasher_.hash(pass, [this, self, user](std::vector<unsigned char> salt, std::vector<unsigned char> hash) {
+                                 int iterations = hasher_.iterations();
+                                 submit_write(storage_.catalog_writer(), [user, salt = std::move(salt), hash = std::move(hash), iterations](Database& db) {
+                                                  return db.create_user(user, salt, hash, iterations);
+                                              },
+                                              [this, self](bool ok) { finish_request(ok ? ok_packet() : error_packet("user exists")); });
+                             })) finish_request(error_packet("server busy"));
+                     })) pending = true;
+            else response = error_packet("server busy");
+            break;
+        }
+        case Op::Login: {
+            std::string user = req.username, pass = req.password;
+            bool acks = format_ == proto::Format::Binary || req.acks;
+            if (submit_read([user](Storage& db) { return db.get_user(user); }, [this, self, user, pass, acks](std::optional<UserRecord> rec) {
+                    if (!rec) { finish_request(error_packet("no such user")); return; }
+                    if (!hasher_.verify(pass, rec->salt, rec->hash, rec->iterations, [this, self, user, acks](bool ok) {
+                            boost::asio::post(stream_.get_executor(), [this, self, user, ok, acks]() { finish_login(user, ok, acks); });
+                        })) finish_request(error_packet("server busy"));
+                })) pending = true;
+            else response = error_packet("server busy");
+            break;
+        }
+        case Op::Send: {
+            std::string from = *logged_user_, to = req.to, content = req.message;
+            auto id = std::make_shared<sqlite3_int64>(0);
+            // wiadomość leży w shardzie odbiorcy, razem z jego stanem dostarczenia
+            submit_write(storage_.writer_for(to), [from, to, content, id](Database& db) { return (*id = db.save_message(from, to, content)) != 0; },
+                         [this, self, from, to, content, id](bool ok) {
+                             if (ok) {
+                                 if (auto peer = presence_.find(to).lock()) {
+                                     peer->write_frame(make_frame(proto::encode(message_packet(*id, from, content), peer->format())), *id);
+                                 }
+                             }
+                             finish_request(ok ? ok_packet() : error_packet("Blocked by trigger"));
+                         });
+            pending = true;
+            break;
+        }
+        case Op::SendGroup: {
+            std::string from = *logged_user_, group = req.group, content = req.message;
+            if (submit_read([group](Storage& db) { return db.get_group(group); }, [this, self, from, group, content](std::optional<GroupRecord> rec) {
+                    if (!rec) { finish_request(error_packet("no such group")); return; }
+                    storage_.save_group_message(from, group, *rec, content, [this, self, from, group, content, members = rec->members](std::vector<sqlite3_int64> ids, bool complete) {
+                        boost::asio::post(stream_.get_executor(), [this, self, from, group, content, members, complete, ids = std::move(ids)]() {
+                            // Jedna serializacja na shard i format, odbiorcy dzielą bufor.
+                            // Odbiorca dostaje id wiersza ze swojego shardu (oryginału albo kopii);
+                            // zapisane kopie idą także wtedy, gdy inny shard zawiódł.
+                            std::vector<Frame> frames(ids.size() * 2);
+                            for (const auto& m : members) {
+                                std::size_t shard = storage_.shard_of(m);
+                                if (m == from || !ids[shard]) continue;
+                                if (auto peer = presence_.find(m).lock()) {
+                                    Frame& frame = frames[shard * 2 + (peer->format() == proto::Format::Binary)];
+                                    if (!frame) frame = make_frame(proto::encode(message_packet(ids[shard], from + "@" + group, content), peer->format()));
+                                    peer->write_frame(frame, ids[shard]);
+                                }
                             }
-                            db_.mark_delivered(user); response["type"] = "ok";
-                        }
+                            if (!ids[storage_.shard_of(from)]) finish_request(error_packet("cannot save message"));
+                            else if (!complete) finish_request(error_packet("message not saved for all group members"));
+                            else finish_request(ok_packet());
+                        });
+                    });
+                })) pending = true;
+            else response = error_packet("server busy");
+            break;
+        }
+        case Op::GroupMembers: {
+            std::string group = req.group;
+            if (submit_read([group](Storage& db) {
+                    proto::Packet res;
+                    res.op = Op::GroupMembersResult;
+                    res.group = group;
+                    res.members = db.get_group_members(group);
+                    return res;
+                }, [this, self](proto::Packet res) { finish_request(res); })) pending = true;
+            else response = error_packet("server busy");
+            break;
+        }
+        case Op::Stats: {
+            std::string user = *logged_user_;
+            if (submit_read([user](Storage& db) {
+                    proto::Packet res;
+                    res.op = Op::StatsResult;
+                    res.data = db.get_stats(user);
+                    return res;
+                }, [this, self](proto::Packet res) { finish_request(res); })) pending = true;
+            else response = error_packet("server busy");
+            break;
+        }
+        case Op::CreateGroup:
+        case Op::JoinGroup: {
+            std::string group = req.group, user = *logged_user_;
+            bool create = req.op == Op::CreateGroup;
+            submit_write(storage_.catalog_writer(), [group, user, create](Database& db) {
+                             if (create && !db.create_group(group)) return false;
+                             db.add_to_group(group, user);
+                             return true;
+                         },
+                         [this, self](bool ok) { finish_request(ok ? ok_packet() : error_packet("")); });
+            pending = true;
+            break;
+        }
+        case Op::History: {
+            std::size_t limit = req.limit ? std::min<std::size_t>(req.limit, cfg_.history_page_max) : cfg_.history_page;
+            std::string user = *logged_user_;
+            sqlite3_int64 before_id = req.before_id;
+            if (submit_read([user, before_id, limit](Storage& db) {
+                    auto page = db.get_history(user, before_id, static_cast<int>(limit));
+                    proto::Packet res;
+                    res.op = Op::HistoryResult;
+                    // pełna strona -> mogą być starsze; kursorem jest najmniejsze id na stronie
+                    if (page.size() == limit) res.next_before = page.front().id;
+                    for (auto& m : page) {
+                        res.messages.push_back({m.id, m.from, m.to, m.content, m.ts, m.group, {}});
                     }
-                }
-                else if (type == "send") {
-                    std::string to = req.value("to", ""), content = req.value("message", "");
-                    if (db_.save_message(*logged_user_, to, content)) {
-                        auto it = active_sessions_.find(to);
-                        if (it != active_sessions_.end()) {
-                            json msg; msg["type"] = "message"; msg["from"] = *logged_user_; msg["message"] = content;
-                            std::string out = msg.dump(); std::vector<char> data(out.begin(), out.end()); it->second->write_message(data);
-                        }
-                        response["type"] = "ok";
-                    } else { response["type"] = "error"; response["message"] = "Blocked by trigger"; }
-                }
-                else if (type == "send_group") {
-                    std::string group = req.value("group", ""), content = req.value("message", "");
-                    auto members = db_.get_group_members(group);
-                    for (const auto& m : members) {
-                        if (m == *logged_user_) continue;
-                        db_.save_message(*logged_user_, m, "[GROUP:"+group+"] " + content);
-                        if (active_sessions_.count(m)) {
-                            json gmsg; gmsg["type"] = "message"; gmsg["from"] = *logged_user_ + "@" + group; gmsg["message"] = content;
-                            std::string out = gmsg.dump(); std::vector<char> d(out.begin(), out.end()); active_sessions_[m]->write_message(d);
-                        }
+                    return res;
+                }, [this, self](proto::Packet res) { finish_request(res); })) pending = true;
+            else response = error_packet("server busy");
+            break;
+        }
+        case Op::Search: {
+            std::size_t limit = req.limit ? std::min<std::size_t>(req.limit, cfg_.search_page_max) : cfg_.search_page;
+            std::size_t offset = req.offset;
+            std::string user = *logged_user_, query = req.query;
+            if (query.find_first_not_of(" \t\r\n*") == std::string::npos) { response = error_packet("empty query"); break; }
+            if (offset > cfg_.search_max_offset) { response = error_packet("search offset too large"); break; }
+            std::size_t max_offset = cfg_.search_max_offset;
+            if (submit_read([user, query, offset, limit, max_offset](Storage& db) {
+                    // o jeden więcej, żeby wiedzieć, czy jest następna strona
+                    auto hits = db.search(user, query, static_cast<int>(offset), static_cast<int>(limit + 1));
+                    proto::Packet res;
+                    res.op = Op::SearchResult;
+                    if (hits.size() > limit) {
+                        hits.pop_back();
+                        if (offset + limit <= max_offset) res.next_offset = static_cast<uint32_t>(offset + limit);
+                    }
+                    for (auto& h : hits) {
+                        auto& m = h.message;
+                        res.messages.push_back({m.id, m.from, m.to, m.content, m.ts, m.group, h.snippet});
                     }
-                    response["type"] = "ok";
-                }
-                else if (type == "group_members") {
-                    response["type"] = "group_members"; response["group"] = req.value("group", "");
-                    auto m = db_.get_group_members(req.value("group", ""));
-                    json arr = json::array(); for(const auto& x : m) arr.push_back(x);
-                    response["members"] = arr;
-                }
-                else if (type == "stats") { response["type"] = "stats"; response["data"] = db_.get_stats(*logged_user_); }
-                else if (type == "create_group") { if(db_.create_group(req.value("group", ""))) { db_.add_to_group(req.value("group", ""), *logged_user_); response["type"] = "ok"; } else response["type"] = "error"; }
-                else if (type == "join_group") { db_.add_to_group(req.value("group", ""), *logged_user_); response["type"] = "ok"; }
-                else if (type == "history") {
-                    auto rows = db_.get_history(*logged_user_); json arr = json::array();
-                    for (auto& m : rows) arr.push_back({{"from", m.from}, {"to", m.to}, {"message", m.content}, {"ts", m.ts}});
-                    response["type"] = "history"; response["messages"] = arr;
-                }
-            } catch (...) { response["type"] = "error"; response["message"] = "invalid json"; }
-            std::string out = response.dump(); std::vector<char> data(out.begin(), out.end()); write_message(data);
+                    return res;
+                }, [this, self](proto::Packet res) { finish_request(res); })) pending = true;
+            else response = error_packet("server busy");
+            break;
+        }
+        case Op::Ack:
+            // potwierdzenia nie dostają odpowiedzi; bez trybu Ack oznacza zapis ramki
+            if (acks_) mark_delivered(delivery_.ack(req.id));
+            record_request(false);
+            read_header();
+            return;
+        case Op::Pong:
+            // sam odczyt ramki odświeżył last_read_
+            heartbeats_ = true;
+            record_request(false);
             read_header();
+            return;
+        default:
+            break;
         }
+    } catch (const proto::DecodeError& e) { response = error_packet(e.what()); }
+    catch (...) { response = error_packet("internal error"); }
+    if (!pending) finish_request(response);
+}
+
+// Odrzucenie nie kosztuje tokenów w pozostałych wiadrach, ale adres płaci za każde żądanie.
+bool Session::within_limits(proto::Op op) {
+    bool auth = op == proto::Op::Login || op == proto::Op::Register;
+    if (!limits_.ip.allow(peer_ip_)) metrics_.rate_limited_ip.inc();
+    else if (auth && !limits_.auth.allow(peer_ip_)) metrics_.rate_limited_auth.inc();
+    else if (!auth && logged_user_ && !limits_.user.allow(*logged_user_)) metrics_.rate_limited_user.inc();
+    else {
+        limit_strikes_ = 0;
+        return true;
+    }
+    return false;
+}
+
+void Session::finish_login(const std::string& user, bool password_ok, bool acks) {
+    if (!password_ok) { finish_request(error_packet("wrong password")); return; }
+    if (logged_user_) presence_.remove(*logged_user_, weak_from_this());
+    // Obecność przed pierwszym odczytem zaległych: wiadomość zapisana później
+    // przyjdzie na żywo, a wcześniejszą zobaczy strumień zaległych.
+    logged_user_ = user; presence_.add(user, weak_from_this());
+    acks_ = acks;
+    if (acks) heartbeats_ = true;
+    ++backlog_gen_;
+    delivery_.reset();
+    writing_messages_ = 0;
+    finish_request(ok_packet());
+    pump_backlog();
+}
+
+// Jedna porcja zaległych; następną uruchamia flush, gdy kolejka wyjściowa opustoszeje.
+void Session::pump_backlog() {
+    if (!delivery_.streaming() || backlog_reading_ || closed_ || writing_ || !outbox_.empty()) return;
+    backlog_reading_ = true;
+    std::string user = *logged_user_;
+    sqlite3_int64 after = delivery_.cursor();
+    int limit = static_cast<int>(cfg_.backlog_chunk);
+    bool queued = submit_read([user, after, limit](Storage& db) { return db.get_undelivered(user, after, limit); },
+                              [this, gen = backlog_gen_](std::vector<MessageRecord> chunk) {
+        backlog_reading_ = false;
+        // porcja z poprzedniego logowania: zaczynamy od nowa z bieżącym kursorem
+        if (gen != backlog_gen_) { pump_backlog(); return; }
+        if (!delivery_.streaming() || closed_) return;
+        bool done = chunk.size() < cfg_.backlog_chunk;
+        for (auto& m : chunk) {
+            if (!delivery_.backlog_message(m.id)) continue;
+            enqueue(make_frame(proto::encode(message_packet(m.id, m.group.empty() ? m.from : m.from + "@" + m.group, m.content, m.ts), format_)), m.id);
+            if (closed_) return;
+            // duże wiadomości: reszta porcji poczeka, zamiast zbliżać się do max_outbox_bytes
+            if (outbox_bytes_ > cfg_.max_outbox_bytes / 2) { done = false; break; }
+        }
+        if (done) delivery_.backlog_done();
     });
+    if (queued) return;
+    // pula odczytów pełna: ponawiamy za chwilę, nic innego nie obudzi strumienia zaległych
+    backlog_reading_ = false;
+    auto self = shared_from_this();
+    auto retry = std::make_shared<boost::asio::steady_timer>(stream_.get_executor(), std::chrono::milliseconds(10));
+    retry->async_wait([this, self, retry](boost::system::error_code) { pump_backlog(); });
 }
 
-void Session::write_message(const std::vector<char>& msg) {
+void Session::mark_delivered(std::vector<sqlite3_int64> ids) {
+    if (ids.empty() || !logged_user_) return;
+    storage_.writer_for(*logged_user_).submit([user = *logged_user_, ids = std::move(ids)](Database& db) { db.mark_delivered(user, ids); return true; });
+}
+
+// zapis przez DbExecutor; on_done wraca na strand sesji dopiero po COMMIT partii
+void Session::submit_write(DbExecutor& writer, DbExecutor::Op op, std::function<void(bool)> on_done) {
     auto self = shared_from_this();
-    uint32_t len = htonl(static_cast<uint32_t>(msg.size()));
-    std::vector<boost::asio::const_buffer> buffers{ boost::asio::buffer(&len, 4), boost::asio::buffer(msg) };
-    boost::asio::async_write(stream_, buffers, [this, self](boost::system::error_code, std::size_t) {});
+    writer.submit(std::move(op), [this, self, on_done = std::move(on_done)](bool ok) {
+        boost::asio::post(stream_.get_executor(), [ok, on_done]() { on_done(ok); });
+    });
+}
+
+void Session::finish_request(const proto::Packet& response) {
+    enqueue(make_frame(proto::encode(response, format_)));
+    record_request(response.op == proto::Op::Error);
+    read_header();
+}
+
+void Session::record_request(bool error) {
+    auto& m = metrics_.requests[request_op_];
+    m.total.inc();
+    if (error) m.errors.inc();
+    m.latency.observe(std::chrono::steady_clock::now() - request_started_);
+}
+
+// Wołane także z sesji innych użytkowników (z innych wątków), więc przechodzi
+// na strand tej sesji; na strandzie sesja używa enqueue bezpośrednio.
+void Session::write_frame(Frame frame, sqlite3_int64 message_id) {
+    auto self = shared_from_this();
+    boost::asio::post(stream_.get_executor(), [this, self, frame = std::move(frame), message_id]() mutable {
+        // strumień zaległych już ją wysłał (zapisana przed jego odczytem)
+        if (!delivery_.live_message(message_id)) return;
+        enqueue(std::move(frame), message_id);
+    });
+}
+
+void Session::enqueue(Frame frame, sqlite3_int64 message_id) {
+    if (closed_) return;
+    outbox_bytes_ += frame->size();
+    metrics_.outbox_frames.add(1);
+    metrics_.outbox_bytes.add(static_cast<int64_t>(frame->size()));
+    outbox_.push_back({std::move(frame), message_id});
+    // Wolny odbiorca: rozłączamy zamiast trzymać rosnącą kolejkę. Wiadomości są już
+    // zapisane w bazie, więc dostanie je przy następnym logowaniu.
+    if (outbox_bytes_ > cfg_.max_outbox_bytes) {
+        metrics_.slow_consumer_disconnects.inc();
+        std::cerr << "Disconnecting slow consumer " << logged_user_.value_or("?") << " (" << outbox_bytes_ << " bytes queued)\n";
+        close();
+        return;
+    }
+    if (!writing_) flush();
+}
+
+// ssl::stream szyfruje tylko pierwszy bufor sekwencji na jedno write_some, więc
+// scatter-gather i tak dałby osobny rekord TLS na ramkę. Zamiast tego ramki
+// oczekujące w kolejce są sklejane do jednego bufora (pojemność jest
+// reużywana) i idą jednym async_write, czyli w możliwie pełnych rekordach.
+void Session::flush() {
+    std::size_t total = 0, count = 0;
+    for (const auto& out : outbox_) {
+        if (count && total + out.frame->size() > kMaxWriteChunk) break;
+        total += out.frame->size();
+        ++count;
+    }
+    write_buf_ = buffers_.acquire(total);
+    char* out = write_buf_.data();
+    for (; count; --count) {
+        const auto& frame = *outbox_.front().frame;
+        if (outbox_.front().message_id) {
+            delivery_.written(outbox_.front().message_id);
+            ++writing_messages_;
+        }
+        std::memcpy(out, frame.data(), frame.size());
+        out += frame.size();
+        outbox_bytes_ -= frame.size();
+        metrics_.outbox_frames.add(-1);
+        metrics_.outbox_bytes.add(-static_cast<int64_t>(frame.size()));
+        outbox_.pop_front();
+    }
+    writing_ = true;
+    auto self = shared_from_this();
+    transport_write(boost::asio::buffer(write_buf_.data(), write_buf_.size()), [this, self](boost::system::error_code ec, std::size_t) {
+        writing_ = false;
+        write_buf_.reset(); // bezczynna sesja nie trzyma bufora
+        if (ec) { close(); return; }
+        // klient bez Ack: zapis na gniazdo to wszystko, co wiemy o dostarczeniu
+        if (!acks_) mark_delivered(delivery_.take(writing_messages_));
+        writing_messages_ = 0;
+        if (!outbox_.empty()) flush();
+        else if (close_after_flush_) close();
+        else pump_backlog();
+    });
+}
+
+void Session::schedule_check(std::chrono::steady_clock::duration delay) {
+    std::weak_ptr<Session> weak = weak_from_this();
+    timers_.schedule(delay, [weak]() {
+        if (auto self = weak.lock()) boost::asio::post(self->stream_.get_executor(), [self]() { self->check_timeouts(); });
+    });
+}
+
+// Reaper: zawieszony handshake i połączenie bez ruchu przychodzącego są zamykane.
+// Po heartbeat_s ciszy wysyłamy Ping; klient, który żyje, odpowiada Pong. Sesji,
+// która nie zadeklarowała obsługi Ping, nie zamykamy za ciszę (keepalive TCP).
+// Ruch tylko aktualizuje last_read_, a sesja sama przestawia swój wpis w kole.
+void Session::check_timeouts() {
+    if (closed_) return;
+    using namespace std::chrono;
+    auto now = steady_clock::now();
+    if (!handshake_done_) {
+        auto left = handshake_started_ + seconds(cfg_.handshake_timeout_s) - now;
+        if (left > steady_clock::duration::zero()) { schedule_check(left); return; }
+        metrics_.handshake_timeouts.inc();
+        close();
+        return;
+    }
+    if (cfg_.idle_timeout_s == 0) return;
+    // może jeszcze zadeklarować (login), więc wpis w kole zostaje
+    if (!heartbeats_) { schedule_check(seconds(cfg_.idle_timeout_s)); return; }
+    auto idle = now - last_read_;
+    if (idle >= seconds(cfg_.idle_timeout_s)) {
+        metrics_.idle_timeouts.inc();
+        close();
+        return;
+    }
+    bool heartbeat = cfg_.heartbeat_s != 0;
+    if (heartbeat && !ping_sent_ && idle >= seconds(cfg_.heartbeat_s)) {
+        ping_sent_ = true;
+        metrics_.heartbeats.inc();
+        proto::Packet ping;
+        ping.op = proto::Op::Ping;
+        enqueue(make_frame(proto::encode(ping, format_)));
+    }
+    schedule_check((heartbeat && !ping_sent_ ? seconds(cfg_.heartbeat_s) : seconds(cfg_.idle_timeout_s)) - idle);
+}
+
+void Session::close() {
+    if (closed_) return;
+    closed_ = true;
+    metrics_.outbox_frames.add(-static_cast<int64_t>(outbox_.size()));
+    metrics_.outbox_bytes.add(-static_cast<int64_t>(outbox_bytes_));
+    outbox_.clear();
+    outbox_bytes_ = 0;
+    boost::system::error_code ignored;
+    stream_.lowest_layer().shutdown(tcp::socket::shutdown_both, ignored);
+    stream_.lowest_layer().close(ignored);
 }
@@ -3,36 +3,128 @@
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <array>
+#include <chrono>
+#include <deque>
 #include <vector>
 #include <memory>
 #include <optional>
 #include <string>
-#include <unordered_map>
 
-#include "../db/Database.hpp"
+#include "../../common/Protocol.hpp"
+#include "DeliveryLog.hpp"
+#include "Frame.hpp"
+#include "Ktls.hpp"
+#include "ServerContext.hpp"
 
 class Session : public std::enable_shared_from_this<Session> {
 public:
     Session(boost::asio::ip::tcp::socket socket,
             boost::asio::ssl::context& ssl_ctx,
-            Database& db);
+            ServerContext& ctx);
     ~Session();
 
     void start();
+    proto::Format format() const { return format_; }
+
+    // ile bajtów kolejki wyjściowej sklejamy w jeden zapis
+    static constexpr std::size_t kMaxWriteChunk = 64 * 1024;
 
 private:
     void on_handshake(const boost::system::error_code& ec);
     void read_header();
     void read_body(std::size_t length);
-    void write_message(const std::vector<char>& msg);
+    void reject_frame(std::size_t length);
+    void handle_request();
+    bool within_limits(proto::Op op);
+    void finish_login(const std::string& user, bool password_ok, bool acks);
+    void pump_backlog();
+    void mark_delivered(std::vector<sqlite3_int64> ids);
+    // writer pliku, do którego należy zapis: katalog albo shard odbiorcy
+    void submit_write(DbExecutor& writer, DbExecutor::Op op, std::function<void(bool)> on_done);
+
+    // Odczyt z bazy na puli odczytów: SQLite czyta plik blokująco, więc nie na
+    // wątku I/O. then dostaje wynik na strandzie sesji; false = kolejka pełna.
+    template <typename Read, typename Then>
+    bool submit_read(Read read, Then then) {
+        auto self = shared_from_this();
+        return db_reads_.try_submit([this, self, read = std::move(read), then = std::move(then)]() {
+            auto result = read(storage_);
+            boost::asio::post(stream_.get_executor(), [self, then, result = std::move(result)]() mutable { then(std::move(result)); });
+        });
+    }
+    void finish_request(const proto::Packet& response);
+    void record_request(bool error);
+    void write_frame(Frame frame, sqlite3_int64 message_id);
+    void enqueue(Frame frame, sqlite3_int64 message_id = 0);
+    void flush();
+    void close();
+    void schedule_check(std::chrono::steady_clock::duration delay);
+    void check_timeouts();
+
+    // Po włączeniu kTLS rekordy szyfruje jądro, więc I/O idzie wprost na gniazdo.
+    template <typename Buffer, typename Handler>
+    void transport_read(const Buffer& buffer, Handler&& handler) {
+        if (ktls_rx_) boost::asio::async_read(stream_.next_layer(), buffer, std::forward<Handler>(handler));
+        else boost::asio::async_read(stream_, buffer, std::forward<Handler>(handler));
+    }
+    template <typename Buffer, typename Handler>
+    void transport_write(const Buffer& buffer, Handler&& handler) {
+        if (ktls_tx_) boost::asio::async_write(stream_.next_layer(), buffer, std::forward<Handler>(handler));
+        else boost::asio::async_write(stream_, buffer, std::forward<Handler>(handler));
+    }
 
     boost::asio::ssl::stream<boost::asio::ip::tcp::socket> stream_;
     std::array<char, 4> header_{};
-    std::vector<char> body_;
+    BufferPool::Lease body_; // tylko między odczytem a zdekodowaniem żądania
+    // ustalany raz po handshake'u, zanim sesja trafi do PresenceRegistry
+    proto::Format format_ = proto::Format::Json;
+
+    // Kolejka wyjściowa: w locie zawsze co najwyżej jeden async_write.
+    // message_id != 0 dla wiadomości, które trzeba potem oznaczyć jako dostarczone.
+    struct Outgoing {
+        Frame frame;
+        sqlite3_int64 message_id;
+    };
+    std::deque<Outgoing> outbox_;
+    std::size_t outbox_bytes_ = 0;
+    BufferPool::Lease write_buf_; // sklejone ramki w locie
+    bool writing_ = false;
+    bool closed_ = false;
+    bool close_after_flush_ = false; // po odrzuceniu ramki: wyślij błąd i zamknij
+    bool ktls_rx_ = false;
+    bool ktls_tx_ = false;
+
+    // Zaległe wiadomości po logowaniu idą porcjami; kolejną czytamy z bazy dopiero,
+    // gdy poprzednia zeszła z kolejki wyjściowej. W bazie oznaczane jest tylko to,
+    // co faktycznie poszło na drut i klient potwierdził (Ack), a klient bez Ack -
+    // to, czego zapis się zakończył.
+    DeliveryLog delivery_;
+    bool backlog_reading_ = false; // porcja w drodze z puli odczytów
+    unsigned backlog_gen_ = 0;     // numer logowania, którego dotyczy porcja
+    std::size_t writing_messages_ = 0; // wiadomości w bieżącym async_write
+    bool acks_ = false;
 
-    Database& db_;
+    const ServerConfig& cfg_;
+    Storage& storage_;
+    WorkerPool& db_reads_;
+    BufferPool& buffers_;
+    TimerWheel& timers_;
+    PresenceRegistry& presence_;
+    PasswordHasher& hasher_;
+    ServerMetrics& metrics_;
+    RateLimits& limits_;
     std::optional<std::string> logged_user_;
+    std::string peer_ip_; // klucz limitów per adres
+    std::size_t limit_strikes_ = 0; // odrzucone z rzędu przez limity
 
-    static std::unordered_map<std::string, Session*> active_sessions_;
+    std::chrono::steady_clock::time_point handshake_started_;
+    std::chrono::steady_clock::time_point last_read_; // ostatnia ramka od klienta
+    bool handshake_done_ = false;
+    bool ping_sent_ = false; // Ping bez odpowiedzi od ostatniej ramki klienta
+    // klient odpowiada na Ping (binarny, login z "acks" albo przysłał Pong); tylko
+    // takie sesje zamykamy za ciszę, resztę pilnuje TCP keepalive
+    bool heartbeats_ = false;
+    std::chrono::steady_clock::time_point request_started_;
+    std::size_t request_op_ = 0; // indeks w ServerMetrics::requests
 };
 
@@ -2,17 +2,28 @@
 
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
-#include "../db/Database.hpp"
+#include "../db/Storage.hpp"
+#include "../Config.hpp"
+#include "../auth/PasswordHasher.hpp"
+#include "AdminServer.hpp"
+#include "PresenceRegistry.hpp"
+#include "ServerContext.hpp"
+#include "ServerMetrics.hpp"
 #include <array>
+#include <memory>
+#include <string>
 
 class TcpServer {
 public:
-    TcpServer(boost::asio::io_context& io, unsigned short port);
+    TcpServer(boost::asio::io_context& io, const ServerConfig& cfg);
 
 private:
+    void configure_tls();
     void accept();
     void start_udp_discovery();
+    std::string render_metrics();
 
+    ServerConfig cfg_;
     boost::asio::io_context& io_;
     boost::asio::ip::tcp::acceptor acceptor_;
     
@@ -22,5 +33,14 @@ private:
     std::array<char, 1024> udp_buf_;
 
     boost::asio::ssl::context ssl_ctx_;
-    Database db_;
+    Storage storage_;
+    WorkerPool db_reads_;
+    PresenceRegistry presence_;
+    PasswordHasher hasher_;
+    ServerMetrics metrics_;
+    BufferPool buffers_;
+    TimerWheel timers_;
+    RateLimits limits_;
+    ServerContext ctx_;
+    std::unique_ptr<AdminServer> admin_;
 };
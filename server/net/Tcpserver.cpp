@@ -1,32 +1,193 @@
 #include "TcpServer.hpp"
 #include "Session.hpp"
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
+#include <vector>
 
 using boost::asio::ip::tcp;
 using boost::asio::ip::udp;
 namespace ssl = boost::asio::ssl;
 
-TcpServer::TcpServer(boost::asio::io_context& io, unsigned short port)
-    : io_(io),
-      acceptor_(io, tcp::endpoint(tcp::v4(), port)),
+TcpServer::TcpServer(boost::asio::io_context& io, const ServerConfig& cfg)
+    : cfg_(cfg),
+      io_(io),
+      acceptor_(io, tcp::endpoint(tcp::v4(), cfg.port)),
       udp_sock_(io, udp::endpoint(udp::v4(), 8888)),
       ssl_ctx_(ssl::context::tls_server),
-      db_("chat.db")
+      storage_(cfg.db_path, cfg.db_shards, cfg.db, cfg.db_batch, std::chrono::microseconds(cfg.db_linger_us)),
+      db_reads_(std::max<std::size_t>(1, cfg.db.readers), cfg.db_read_queue),
+      hasher_(cfg.hash_threads, cfg.hash_queue, cfg.pbkdf2_iterations),
+      buffers_(std::max(cfg.max_frame_bytes, Session::kMaxWriteChunk), cfg.buffer_pool_keep),
+      timers_(io, std::chrono::milliseconds(250), 1024),
+      limits_{{cfg.rate_user, cfg.rate_user_burst}, {cfg.rate_ip, cfg.rate_ip_burst}, {cfg.rate_auth, cfg.rate_auth_burst}},
+      ctx_{cfg_, storage_, db_reads_, presence_, hasher_, metrics_, buffers_, timers_, limits_}
 {
+    configure_tls();
+
+    // ALPN: protokół binarny tylko dla klientów, które go zaproponują; bez ALPN zostaje JSON
+    SSL_CTX_set_alpn_select_cb(ssl_ctx_.native_handle(),
+        [](SSL*, const unsigned char** out, unsigned char* outlen, const unsigned char* in, unsigned int inlen, void*) {
+            unsigned char* selected = nullptr;
+            if (SSL_select_next_proto(&selected, outlen, proto::kAlpnWire, sizeof(proto::kAlpnWire), in, inlen) != OPENSSL_NPN_NEGOTIATED) {
+                return SSL_TLSEXT_ERR_NOACK;
+            }
+            *out = selected;
+            return SSL_TLSEXT_ERR_OK;
+        }, nullptr);
+
+    auto mcast_addr = boost::asio::ip::make_address_v4("239.255.0.1");
+    udp_sock_.set_option(boost::asio::ip::multicast::join_group(mcast_addr));
+
+    if (cfg_.admin_port != 0) {
+        // zajęty port administracyjny nie blokuje startu czatu
+        try {
+            tcp::endpoint ep(boost::asio::ip::make_address(cfg_.admin_bind), cfg_.admin_port);
+            admin_ = std::make_unique<AdminServer>(io_, ep, [this]() { return render_metrics(); });
+        } catch (const std::exception& e) {
+            std::cerr << "Admin endpoint disabled: " << e.what() << "\n";
+        }
+    }
+
+    accept();
+    start_udp_discovery();
+}
+
+void TcpServer::configure_tls() {
+    SSL_CTX* ctx = ssl_ctx_.native_handle();
     ssl_ctx_.set_options(
         ssl::context::default_workarounds |
         ssl::context::no_sslv2 |
-        ssl::context::no_sslv3
+        ssl::context::no_sslv3 |
+        ssl::context::no_tlsv1 |
+        ssl::context::no_tlsv1_1
     );
+    // kolejność z konfiguracji (najtańsze szyfry pierwsze) wygrywa z preferencją klienta
+    SSL_CTX_set_options(ctx, SSL_OP_CIPHER_SERVER_PREFERENCE);
+    SSL_CTX_set_min_proto_version(ctx, cfg_.tls_min_version == "1.3" ? TLS1_3_VERSION : TLS1_2_VERSION);
+    SSL_CTX_set_max_proto_version(ctx, 0);
+    if (SSL_CTX_set_ciphersuites(ctx, cfg_.tls_ciphersuites.c_str()) != 1) throw std::invalid_argument("invalid --tls-ciphersuites");
+    if (SSL_CTX_set_cipher_list(ctx, cfg_.tls_ciphers.c_str()) != 1) throw std::invalid_argument("invalid --tls-ciphers");
+    if (SSL_CTX_set1_groups_list(ctx, cfg_.tls_groups.c_str()) != 1) throw std::invalid_argument("invalid --tls-groups");
 
     ssl_ctx_.use_certificate_chain_file("certs/server.crt");
     ssl_ctx_.use_private_key_file("certs/server.key", ssl::context::pem);
 
-    auto mcast_addr = boost::asio::ip::make_address_v4("239.255.0.1");
-    udp_sock_.set_option(boost::asio::ip::multicast::join_group(mcast_addr));
+    // Wznawianie sesji: bilety (klucze w pamięci procesu, serwer nic nie przechowuje)
+    // albo cache sesji po stronie serwera. Po restarcie klienci robią pełny handshake.
+    static const unsigned char sid_ctx[] = "chat";
+    SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx) - 1);
+    SSL_CTX_set_timeout(ctx, cfg_.tls_session_timeout);
+    if (cfg_.tls_resumption == "tickets") {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    } else if (cfg_.tls_resumption == "cache") {
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET); // TLS 1.3 dostaje wtedy bilety stanowe z cache
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(ctx, cfg_.tls_session_cache);
+    } else {
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+        SSL_CTX_set_num_tickets(ctx, 0);
+    }
+    if (cfg_.ktls) ktls::prepare_context(ctx);
+}
 
-    accept();
-    start_udp_discovery();
+std::string TcpServer::render_metrics() {
+    PrometheusWriter w;
+    std::vector<std::pair<std::string, const ServerMetrics::Request*>> requests;
+    for (std::size_t i = 0; i < metrics_.requests.size(); ++i) {
+        const char* name = i ? proto::op_name(static_cast<proto::Op>(i)) : "unknown";
+        if (*name) requests.emplace_back(std::string("type=\"") + name + "\"", &metrics_.requests[i]);
+    }
+    w.family("chat_requests_total", "counter", "Requests handled, by type.");
+    for (auto& [labels, r] : requests) w.sample("chat_requests_total", labels, static_cast<double>(r->total.value()));
+    w.family("chat_request_errors_total", "counter", "Requests answered with an error, by type.");
+    for (auto& [labels, r] : requests) w.sample("chat_request_errors_total", labels, static_cast<double>(r->errors.value()));
+    w.family("chat_request_duration_seconds", "histogram", "Time from request body received to response queued.");
+    for (auto& [labels, r] : requests) w.histogram("chat_request_duration_seconds", labels, r->latency);
+    // z shardami każda seria dostaje etykietę pliku (catalog, shard0, ...)
+    auto db_label = [this](std::size_t f, std::string labels) {
+        if (!storage_.sharded()) return labels;
+        return labels + (labels.empty() ? "" : ",") + "db=\"" + storage_.file_name(f) + "\"";
+    };
+    w.family("chat_db_duration_seconds", "histogram", "Database method latency, including connection and lock wait.");
+    for (std::size_t f = 0; f < storage_.file_count(); ++f) {
+        for (std::size_t i = 0; i < DbMetrics::Count; ++i) {
+            auto m = static_cast<DbMetrics::Method>(i);
+            w.histogram("chat_db_duration_seconds", db_label(f, std::string("method=\"") + DbMetrics::name(m) + "\""), storage_.file(f).metrics().latency[i]);
+        }
+    }
+    w.family("chat_tls_handshakes_total", "counter", "Completed TLS handshakes, full or resumed.");
+    w.sample("chat_tls_handshakes_total", "mode=\"full\"", static_cast<double>(metrics_.tls_full.total.value()));
+    w.sample("chat_tls_handshakes_total", "mode=\"resumed\"", static_cast<double>(metrics_.tls_resumed.total.value()));
+    w.family("chat_tls_handshake_seconds", "histogram", "TLS handshake duration.");
+    w.histogram("chat_tls_handshake_seconds", "mode=\"full\"", metrics_.tls_full.latency);
+    w.histogram("chat_tls_handshake_seconds", "mode=\"resumed\"", metrics_.tls_resumed.latency);
+    if (cfg_.ktls) {
+        w.family("chat_ktls_sessions_total", "counter", "Kernel TLS offload attempts after the handshake, by result.");
+        for (std::size_t i = 0; i < ktls::Count; ++i) {
+            auto s = static_cast<ktls::Status>(i);
+            w.sample("chat_ktls_sessions_total", std::string("result=\"") + ktls::status_name(s) + "\"", static_cast<double>(metrics_.ktls[i].value()));
+        }
+    }
+    w.family("chat_tls_session_cache_entries", "gauge", "Sessions in the server-side TLS cache.");
+    w.sample("chat_tls_session_cache_entries", "", static_cast<double>(SSL_CTX_sess_number(ssl_ctx_.native_handle())));
+    w.family("chat_tls_handshake_failures_total", "counter", "Failed TLS handshakes.");
+    w.sample("chat_tls_handshake_failures_total", "", static_cast<double>(metrics_.tls_handshake_failures.value()));
+    w.family("chat_sessions_active", "gauge", "Open sessions.");
+    w.sample("chat_sessions_active", "", static_cast<double>(metrics_.sessions_active.value()));
+    w.family("chat_users_online", "gauge", "Logged-in users in the presence registry.");
+    w.sample("chat_users_online", "", static_cast<double>(presence_.size()));
+    w.family("chat_outbox_frames", "gauge", "Frames queued for sending across all sessions.");
+    w.sample("chat_outbox_frames", "", static_cast<double>(metrics_.outbox_frames.value()));
+    w.family("chat_outbox_bytes", "gauge", "Bytes queued for sending across all sessions.");
+    w.sample("chat_outbox_bytes", "", static_cast<double>(metrics_.outbox_bytes.value()));
+    w.family("chat_sessions_reaped_total", "counter", "Sessions closed by the reaper, by reason.");
+    w.sample("chat_sessions_reaped_total", "reason=\"handshake_timeout\"", static_cast<double>(metrics_.handshake_timeouts.value()));
+    w.sample("chat_sessions_reaped_total", "reason=\"idle_timeout\"", static_cast<double>(metrics_.idle_timeouts.value()));
+    w.family("chat_heartbeats_sent_total", "counter", "Ping frames sent to silent clients.");
+    w.sample("chat_heartbeats_sent_total", "", static_cast<double>(metrics_.heartbeats.value()));
+    w.family("chat_timer_wheel_entries", "gauge", "Pending session timeouts in the timer wheel.");
+    w.sample("chat_timer_wheel_entries", "", static_cast<double>(timers_.size()));
+    w.family("chat_rate_limited_total", "counter", "Requests rejected by a rate limit, by scope.");
+    w.sample("chat_rate_limited_total", "scope=\"user\"", static_cast<double>(metrics_.rate_limited_user.value()));
+    w.sample("chat_rate_limited_total", "scope=\"ip\"", static_cast<double>(metrics_.rate_limited_ip.value()));
+    w.sample("chat_rate_limited_total", "scope=\"auth\"", static_cast<double>(metrics_.rate_limited_auth.value()));
+    w.family("chat_rate_limit_disconnects_total", "counter", "Sessions closed after too many rate-limited requests in a row.");
+    w.sample("chat_rate_limit_disconnects_total", "", static_cast<double>(metrics_.rate_limit_disconnects.value()));
+    w.family("chat_rate_limit_buckets", "gauge", "Tracked token buckets, by scope.");
+    w.sample("chat_rate_limit_buckets", "scope=\"user\"", static_cast<double>(limits_.user.size()));
+    w.sample("chat_rate_limit_buckets", "scope=\"ip\"", static_cast<double>(limits_.ip.size()));
+    w.sample("chat_rate_limit_buckets", "scope=\"auth\"", static_cast<double>(limits_.auth.size()));
+    w.family("chat_oversized_frames_total", "counter", "Sessions closed for a frame larger than --max-frame.");
+    w.sample("chat_oversized_frames_total", "", static_cast<double>(metrics_.oversized_frames.value()));
+    w.family("chat_buffer_pool_allocations_total", "counter", "Frame buffers allocated (pool miss or oversized).");
+    w.sample("chat_buffer_pool_allocations_total", "", static_cast<double>(buffers_.allocations()));
+    w.family("chat_buffer_pool_reuses_total", "counter", "Frame buffers served from the pool.");
+    w.sample("chat_buffer_pool_reuses_total", "", static_cast<double>(buffers_.reuses()));
+    w.family("chat_slow_consumer_disconnects_total", "counter", "Sessions closed for exceeding max_outbox_bytes.");
+    w.sample("chat_slow_consumer_disconnects_total", "", static_cast<double>(metrics_.slow_consumer_disconnects.value()));
+    w.family("chat_db_writer_queue", "gauge", "Writes waiting for the DB writer thread.");
+    for (std::size_t f = 0; f < storage_.file_count(); ++f) w.sample("chat_db_writer_queue", db_label(f, ""), static_cast<double>(storage_.file_writer(f).queue_depth()));
+    w.family("chat_db_writer_batches_total", "counter", "Group-commit transactions.");
+    for (std::size_t f = 0; f < storage_.file_count(); ++f) w.sample("chat_db_writer_batches_total", db_label(f, ""), static_cast<double>(storage_.file_writer(f).batches()));
+    w.family("chat_db_writer_ops_total", "counter", "Writes committed by the DB writer thread.");
+    for (std::size_t f = 0; f < storage_.file_count(); ++f) w.sample("chat_db_writer_ops_total", db_label(f, ""), static_cast<double>(storage_.file_writer(f).ops()));
+    w.family("chat_db_read_queue", "gauge", "Database reads waiting for the read pool.");
+    w.sample("chat_db_read_queue", "", static_cast<double>(db_reads_.queue_depth()));
+    w.family("chat_hash_queue", "gauge", "Password hashing jobs waiting.");
+    w.sample("chat_hash_queue", "", static_cast<double>(hasher_.queue_depth()));
+
+    auto caches = storage_.catalog().cache_counters();
+    const std::pair<const char*, const CacheCounters*> cache_list[] = {
+        {"users", &caches.users}, {"group_members", &caches.group_members}, {"group_ids", &caches.group_ids}};
+    w.family("chat_cache_hits_total", "counter", "Database cache hits.");
+    for (auto& [name, c] : cache_list) w.sample("chat_cache_hits_total", std::string("cache=\"") + name + "\"", static_cast<double>(c->hits));
+    w.family("chat_cache_misses_total", "counter", "Database cache misses.");
+    for (auto& [name, c] : cache_list) w.sample("chat_cache_misses_total", std::string("cache=\"") + name + "\"", static_cast<double>(c->misses));
+    w.family("chat_cache_entries", "gauge", "Database cache entries.");
+    for (auto& [name, c] : cache_list) w.sample("chat_cache_entries", std::string("cache=\"") + name + "\"", static_cast<double>(c->size));
+    return w.text();
 }
 
 void TcpServer::start_udp_discovery() {
@@ -46,9 +207,10 @@ void TcpServer::start_udp_discovery() {
 
 void TcpServer::accept() {
     acceptor_.async_accept(
+        boost::asio::make_strand(io_),
         [this](boost::system::error_code ec, tcp::socket socket) {
             if (!ec) {
-                std::make_shared<Session>(std::move(socket), ssl_ctx_, db_)->start();
+                std::make_shared<Session>(std::move(socket), ssl_ctx_, ctx_)->start();
             }
             accept();
         }
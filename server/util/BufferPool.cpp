@@ -0,0 +1,71 @@
+#include "BufferPool.hpp"
+
+BufferPool::Lease::Lease(Lease&& other) noexcept
+    : pool_(other.pool_), cls_(other.cls_), data_(std::move(other.data_)), size_(other.size_) {
+    other.pool_ = nullptr;
+    other.size_ = 0;
+}
+
+BufferPool::Lease& BufferPool::Lease::operator=(Lease&& other) noexcept {
+    if (this != &other) {
+        reset();
+        pool_ = other.pool_;
+        cls_ = other.cls_;
+        data_ = std::move(other.data_);
+        size_ = other.size_;
+        other.pool_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+void BufferPool::Lease::reset() {
+    if (pool_ && data_) pool_->release(cls_, std::move(data_));
+    data_.reset();
+    pool_ = nullptr;
+    size_ = 0;
+}
+
+BufferPool::BufferPool(std::size_t max_buffer, std::size_t keep_per_class) : keep_(keep_per_class) {
+    for (std::size_t size = kMinBuffer;; size *= 2) {
+        auto c = std::make_unique<Class>();
+        c->size = size;
+        classes_.push_back(std::move(c));
+        if (size >= max_buffer) break;
+    }
+}
+
+BufferPool::Lease BufferPool::acquire(std::size_t size) {
+    Lease lease;
+    lease.size_ = size;
+    std::size_t cls = 0;
+    while (cls < classes_.size() && classes_[cls]->size < size) ++cls;
+    if (cls == classes_.size()) {
+        // ponad największą klasę: jednorazowo, bez powrotu do puli
+        allocations_.inc();
+        lease.data_.reset(new char[size]);
+        return lease;
+    }
+    Class& c = *classes_[cls];
+    {
+        std::lock_guard<std::mutex> lock(c.mu);
+        if (!c.free.empty()) {
+            lease.data_ = std::move(c.free.back());
+            c.free.pop_back();
+        }
+    }
+    if (lease.data_) reuses_.inc();
+    else {
+        allocations_.inc();
+        lease.data_.reset(new char[c.size]);
+    }
+    lease.pool_ = this;
+    lease.cls_ = cls;
+    return lease;
+}
+
+void BufferPool::release(std::size_t cls, std::unique_ptr<char[]> data) {
+    Class& c = *classes_[cls];
+    std::lock_guard<std::mutex> lock(c.mu);
+    if (c.free.size() < keep_) c.free.push_back(std::move(data));
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Metrics.hpp"
+
+// Bufory ramek w klasach rozmiaru (potęgi dwójki od kMinBuffer do max_buffer).
+// Zwolniony bufor wraca na listę swojej klasy, więc w stanie ustalonym odczyt
+// i wysyłka ramek nie alokują. Większe bufory są przydzielane na miejscu i nie
+// wracają do puli. Bezpieczne między wątkami (osobny mutex na klasę).
+class BufferPool {
+public:
+    static constexpr std::size_t kMinBuffer = 1024;
+
+    // Bufor wypożyczony z puli; oddaje się sam w destruktorze albo w reset().
+    class Lease {
+    public:
+        Lease() = default;
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&& other) noexcept;
+        ~Lease() { reset(); }
+
+        char* data() { return data_.get(); }
+        const char* data() const { return data_.get(); }
+        std::size_t size() const { return size_; }
+        explicit operator bool() const { return data_ != nullptr; }
+        void reset();
+
+    private:
+        friend class BufferPool;
+        BufferPool* pool_ = nullptr;
+        std::size_t cls_ = 0;
+        std::unique_ptr<char[]> data_;
+        std::size_t size_ = 0;
+    };
+
+    BufferPool(std::size_t max_buffer, std::size_t keep_per_class);
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // size() == size, zawartość niezainicjalizowana
+    Lease acquire(std::size_t size);
+
+    uint64_t allocations() const { return allocations_.value(); }
+    uint64_t reuses() const { return reuses_.value(); }
+
+private:
+    struct Class {
+        std::size_t size = 0;
+        std::mutex mu;
+        std::vector<std::unique_ptr<char[]>> free;
+    };
+
+    void release(std::size_t cls, std::unique_ptr<char[]> data);
+
+    std::size_t keep_;
+    std::vector<std::unique_ptr<Class>> classes_;
+    Counter allocations_;
+    Counter reuses_;
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+struct CacheCounters {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    std::size_t size = 0;
+};
+
+// Ograniczony cache LRU bezpieczny wątkowo.
+// Wypełnianie po odczycie z bazy: generation() przed zapytaniem, put(..., gen) po nim.
+// Każde erase podbija generację, więc wynik zapytania rozpoczętego przed
+// unieważnieniem (stary snapshot) nie trafi już do cache.
+template <class K, class V>
+class LruCache {
+public:
+    explicit LruCache(std::size_t capacity) : capacity_(capacity) {}
+
+    std::optional<V> get(const K& key) {
+        std::lock_guard<std::mutex> lock(mu_);
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+        entries_.splice(entries_.begin(), entries_, it->second);
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return it->second->second;
+    }
+
+    uint64_t generation() const {
+        std::lock_guard<std::mutex> lock(mu_);
+        return generation_;
+    }
+
+    void put(const K& key, V value, uint64_t generation) {
+        std::lock_guard<std::mutex> lock(mu_);
+        if (capacity_ == 0 || generation != generation_) return;
+        if (auto it = index_.find(key); it != index_.end()) {
+            it->second->second = std::move(value);
+            entries_.splice(entries_.begin(), entries_, it->second);
+            return;
+        }
+        entries_.emplace_front(key, std::move(value));
+        index_.emplace(key, entries_.begin());
+        if (index_.size() > capacity_) {
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+        }
+    }
+
+    void erase(const K& key) {
+        std::lock_guard<std::mutex> lock(mu_);
+        ++generation_;
+        if (auto it = index_.find(key); it != index_.end()) {
+            entries_.erase(it->second);
+            index_.erase(it);
+        }
+    }
+
+    CacheCounters counters() const {
+        std::lock_guard<std::mutex> lock(mu_);
+        return {hits_.load(std::memory_order_relaxed), misses_.load(std::memory_order_relaxed), index_.size()};
+    }
+
+private:
+    using Entry = std::pair<K, V>;
+
+    mutable std::mutex mu_;
+    std::size_t capacity_;
+    uint64_t generation_ = 0;
+    std::list<Entry> entries_;
+    std::unordered_map<K, typename std::list<Entry>::iterator> index_;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+};
@@ -0,0 +1,41 @@
+#include "Metrics.hpp"
+#include <cstdio>
+
+static std::string format_value(double v) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.10g", v);
+    return buf;
+}
+
+void PrometheusWriter::family(const char* name, const char* type, const char* help) {
+    out_ += "# HELP ";
+    out_ += name;
+    out_ += ' ';
+    out_ += help;
+    out_ += "\n# TYPE ";
+    out_ += name;
+    out_ += ' ';
+    out_ += type;
+    out_ += '\n';
+}
+
+void PrometheusWriter::sample(const char* name, const std::string& labels, double value) {
+    out_ += name;
+    if (!labels.empty()) out_ += "{" + labels + "}";
+    out_ += ' ';
+    out_ += format_value(value);
+    out_ += '\n';
+}
+
+void PrometheusWriter::histogram(const char* name, const std::string& labels, const LatencyHistogram& h) {
+    std::string base = name;
+    std::string sep = labels.empty() ? "" : ",";
+    uint64_t cumulative = 0;
+    for (std::size_t i = 0; i <= LatencyHistogram::kBounds.size(); ++i) {
+        cumulative += h.bucket(i);
+        std::string le = i < LatencyHistogram::kBounds.size() ? format_value(LatencyHistogram::kBounds[i]) : "+Inf";
+        sample((base + "_bucket").c_str(), labels + sep + "le=\"" + le + "\"", static_cast<double>(cumulative));
+    }
+    sample((base + "_sum").c_str(), labels, h.sum_seconds());
+    sample((base + "_count").c_str(), labels, static_cast<double>(cumulative));
+}
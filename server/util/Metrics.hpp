@@ -0,0 +1,75 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Liczniki bez blokad (relaxed atomics) do eksportu w formacie Prometheus.
+// Zapis to jedno fetch_add, więc można je wołać z gorących ścieżek.
+
+class Counter {
+public:
+    void inc(uint64_t n = 1) { v_.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return v_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> v_{0};
+};
+
+class Gauge {
+public:
+    void add(int64_t n) { v_.fetch_add(n, std::memory_order_relaxed); }
+    int64_t value() const { return v_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> v_{0};
+};
+
+// Histogram o stałych przedziałach (sekundy, jak histogramy Prometheusa).
+class LatencyHistogram {
+public:
+    static constexpr std::array<double, 17> kBounds = {
+        0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+        0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+
+    void observe(std::chrono::nanoseconds d) {
+        double s = std::chrono::duration<double>(d).count();
+        std::size_t i = 0;
+        while (i < kBounds.size() && s > kBounds[i]) ++i;
+        buckets_[i].fetch_add(1, std::memory_order_relaxed);
+        sum_ns_.fetch_add(static_cast<uint64_t>(d.count()), std::memory_order_relaxed);
+    }
+
+    // liczność przedziału i (i == kBounds.size() to +Inf), bez kumulacji
+    uint64_t bucket(std::size_t i) const { return buckets_[i].load(std::memory_order_relaxed); }
+    double sum_seconds() const { return static_cast<double>(sum_ns_.load(std::memory_order_relaxed)) / 1e9; }
+
+private:
+    std::array<std::atomic<uint64_t>, kBounds.size() + 1> buckets_{};
+    std::atomic<uint64_t> sum_ns_{0};
+};
+
+class ScopedTimer {
+public:
+    explicit ScopedTimer(LatencyHistogram& h) : h_(h), start_(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() { h_.observe(std::chrono::steady_clock::now() - start_); }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    LatencyHistogram& h_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Format tekstowy Prometheusa (0.0.4). labels bez nawiasów, np. "type=\"send\"".
+class PrometheusWriter {
+public:
+    void family(const char* name, const char* type, const char* help);
+    void sample(const char* name, const std::string& labels, double value);
+    void histogram(const char* name, const std::string& labels, const LatencyHistogram& h);
+    const std::string& text() const { return out_; }
+
+private:
+    std::string out_;
+};
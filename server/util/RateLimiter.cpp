@@ -0,0 +1,42 @@
+#include "RateLimiter.hpp"
+#include <algorithm>
+#include <functional>
+
+RateLimiter::RateLimiter(double rate, double burst) : rate_(rate), burst_(std::max(burst, 1.0)) {}
+
+bool RateLimiter::allow(const std::string& key, double cost) {
+    if (!enabled()) return true;
+    Shard& shard = shards_[std::hash<std::string>{}(key) % shards_.size()];
+    auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(shard.mu);
+    auto [it, inserted] = shard.buckets.try_emplace(key, Bucket{burst_, now});
+    Bucket& b = it->second;
+    if (!inserted) {
+        b.tokens = std::min(burst_, b.tokens + std::chrono::duration<double>(now - b.last).count() * rate_);
+        b.last = now;
+    }
+    bool ok = b.tokens >= cost;
+    if (ok) b.tokens -= cost;
+    if (inserted && shard.buckets.size() >= shard.sweep_at) sweep(shard, now);
+    return ok;
+}
+
+std::size_t RateLimiter::size() {
+    std::size_t n = 0;
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mu);
+        n += shard.buckets.size();
+    }
+    return n;
+}
+
+// Pełne wiadro niczym się nie różni od braku wpisu. Próg rośnie z liczbą
+// żywych kluczy, więc koszt przeglądania rozkłada się na wstawienia.
+void RateLimiter::sweep(Shard& shard, Clock::time_point now) {
+    auto refill = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(burst_ / rate_));
+    for (auto it = shard.buckets.begin(); it != shard.buckets.end();) {
+        if (it->second.last + refill <= now) it = shard.buckets.erase(it);
+        else ++it;
+    }
+    shard.sweep_at = std::max<std::size_t>(1024, shard.buckets.size() * 2);
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Token bucket per klucz (użytkownik, adres IP): rate tokenów na sekundę,
+// najwyżej burst w zapasie. Nowy klucz zaczyna z pełnym wiadrem. Wiadra, które
+// zdążyłyby się już napełnić, są usuwane przy okazji, więc mapa nie rośnie
+// bez końca. rate == 0 wyłącza limit. Bezpieczne między wątkami (mutex na shard).
+class RateLimiter {
+public:
+    RateLimiter(double rate, double burst);
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    // false = limit przekroczony, żaden token nie został zużyty
+    bool allow(const std::string& key, double cost = 1);
+    bool enabled() const { return rate_ > 0; }
+    std::size_t size();
+
+private:
+    using Clock = std::chrono::steady_clock;
+    struct Bucket {
+        double tokens;
+        Clock::time_point last;
+    };
+    struct Shard {
+        std::mutex mu;
+        std::unordered_map<std::string, Bucket> buckets;
+        std::size_t sweep_at = 1024;
+    };
+
+    void sweep(Shard& shard, Clock::time_point now);
+
+    double rate_;
+    double burst_;
+    std::array<Shard, 16> shards_;
+};
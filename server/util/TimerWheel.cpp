@@ -0,0 +1,51 @@
+#include "TimerWheel.hpp"
+#include <algorithm>
+
+TimerWheel::TimerWheel(boost::asio::io_context& io, std::chrono::milliseconds tick, std::size_t slots)
+    : tick_(tick), timer_(io), next_tick_(std::chrono::steady_clock::now()), slots_(slots) {
+    arm();
+}
+
+void TimerWheel::schedule(std::chrono::steady_clock::duration delay, Callback cb) {
+    // ticks >= 1: wpis w bieżącym slocie odpaliłby dopiero po pełnym obrocie
+    auto ticks = static_cast<uint64_t>(std::max<int64_t>(1, (delay + tick_ - std::chrono::nanoseconds(1)) / tick_));
+    std::lock_guard<std::mutex> lock(mu_);
+    std::size_t slot = (cursor_ + ticks) % slots_.size();
+    slots_[slot].push_back({(ticks - 1) / slots_.size(), std::move(cb)});
+    ++size_;
+}
+
+std::size_t TimerWheel::size() {
+    std::lock_guard<std::mutex> lock(mu_);
+    return size_;
+}
+
+// bez dryfu: kolejny tick liczony od poprzedniego terminu, nie od chwili obsługi
+void TimerWheel::arm() {
+    next_tick_ += tick_;
+    timer_.expires_at(next_tick_);
+    timer_.async_wait([this](boost::system::error_code ec) {
+        if (ec) return;
+        on_tick();
+        arm();
+    });
+}
+
+void TimerWheel::on_tick() {
+    std::vector<Callback> due;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        cursor_ = (cursor_ + 1) % slots_.size();
+        auto& slot = slots_[cursor_];
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < slot.size(); ++i) {
+            if (slot[i].rounds == 0) { due.push_back(std::move(slot[i].cb)); continue; }
+            --slot[i].rounds;
+            if (kept != i) slot[kept] = std::move(slot[i]);
+            ++kept;
+        }
+        slot.erase(slot.begin() + static_cast<std::ptrdiff_t>(kept), slot.end());
+        size_ -= due.size();
+    }
+    for (auto& cb : due) cb();
+}
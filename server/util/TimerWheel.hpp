@@ -0,0 +1,44 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Haszowane koło czasowe: jeden steady_timer tyka co tick, a zadania leżą w slotach
+// (termin modulo liczba slotów, plus licznik pełnych obrotów). Wstawienie i obsługa
+// wygasłego wpisu to O(1), niezależnie od liczby sesji. Nie ma anulowania - callback
+// sam sprawdza, czy jest jeszcze aktualny (np. przez weak_ptr). Callbacki wołane są
+// na wątku io poza blokadą; kto potrzebuje stranda, sam na niego wraca.
+class TimerWheel {
+public:
+    using Callback = std::function<void()>;
+
+    TimerWheel(boost::asio::io_context& io, std::chrono::milliseconds tick, std::size_t slots);
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // wywołuje cb po co najmniej delay (zaokrąglone w górę do ticka); bezpieczne między wątkami
+    void schedule(std::chrono::steady_clock::duration delay, Callback cb);
+    std::size_t size();
+
+private:
+    struct Entry {
+        uint64_t rounds;
+        Callback cb;
+    };
+
+    void arm();
+    void on_tick();
+
+    std::chrono::milliseconds tick_;
+    boost::asio::steady_timer timer_;
+    std::chrono::steady_clock::time_point next_tick_;
+
+    std::mutex mu_;
+    std::vector<std::vector<Entry>> slots_;
+    std::size_t cursor_ = 0;
+    std::size_t size_ = 0;
+};
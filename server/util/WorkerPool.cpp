@@ -0,0 +1,43 @@
+#include "WorkerPool.hpp"
+
+WorkerPool::WorkerPool(std::size_t threads, std::size_t max_queue) : max_queue_(max_queue) {
+    for (std::size_t i = 0; i < threads; ++i) threads_.emplace_back([this]() { run(); });
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : threads_) t.join();
+}
+
+bool WorkerPool::try_submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        if (stop_ || queue_.size() >= max_queue_) return false;
+        queue_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+    return true;
+}
+
+std::size_t WorkerPool::queue_depth() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return queue_.size();
+}
+
+void WorkerPool::run() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mu_);
+            cv_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+            if (stop_) return;
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        task();
+    }
+}
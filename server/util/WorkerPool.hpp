@@ -0,0 +1,31 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Pula wątków do pracy CPU poza reaktorem, z ograniczoną kolejką.
+// try_submit nie blokuje: przy pełnej kolejce od razu zwraca false.
+class WorkerPool {
+public:
+    WorkerPool(std::size_t threads, std::size_t max_queue);
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    bool try_submit(std::function<void()> task);
+    std::size_t queue_depth() const;
+
+private:
+    void run();
+
+    mutable std::mutex mu_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> queue_;
+    std::size_t max_queue_;
+    bool stop_ = false;
+    std::vector<std::thread> threads_;
+};
@@ -0,0 +1,23 @@
+#pragma once
+#include <iostream>
+
+// Minimalne asercje testów regresyjnych: błąd nie przerywa testu, main zwraca
+// report() jako kod wyjścia.
+inline int check_failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed\n"; \
+            ++check_failures; \
+        } \
+    } while (0)
+
+inline int report(const char* name) {
+    if (check_failures) {
+        std::cerr << name << ": " << check_failures << " check(s) failed\n";
+        return 1;
+    }
+    std::cout << name << ": ok\n";
+    return 0;
+}
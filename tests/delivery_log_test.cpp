@@ -0,0 +1,92 @@
+// Regresje księgowania dostarczeń (server/net/DeliveryLog).
+#include "../server/net/DeliveryLog.hpp"
+#include "check.hpp"
+#include <vector>
+
+using Ids = std::vector<sqlite3_int64>;
+
+// Wiadomości na żywo od dwóch writerów przychodzą odwrotnie: Ack 201 nie może
+// oznaczyć 200, której klient jeszcze nie dostał.
+static void out_of_order_live_ack() {
+    DeliveryLog log;
+    log.reset();
+    log.backlog_done();
+    CHECK(log.live_message(201));
+    log.written(201);
+    CHECK(log.ack(201) == Ids{201});
+    CHECK(log.live_message(200));
+    log.written(200);
+    CHECK(log.ack(200) == Ids{200});
+    CHECK(log.unacked() == 0);
+}
+
+// Ack obejmuje wszystkie ramki zapisane przed potwierdzoną, niezależnie od id.
+static void ack_marks_write_order_prefix() {
+    DeliveryLog log;
+    log.reset();
+    log.backlog_done();
+    for (sqlite3_int64 id : {7, 3, 9, 5}) {
+        CHECK(log.live_message(id));
+        log.written(id);
+    }
+    CHECK(log.ack(9) == (Ids{7, 3, 9}));
+    CHECK(log.unacked() == 1);
+    // id spoza kolejki (już potwierdzone albo nigdy nie wysłane) niczego nie oznacza
+    CHECK(log.ack(9).empty());
+    CHECK(log.ack(100).empty());
+    CHECK(log.unacked() == 1);
+}
+
+// Strumień zaległych idzie dalej za pierwszą wiadomość na żywo i pomija tylko
+// te, które już poszły.
+static void backlog_streams_past_live() {
+    DeliveryLog log;
+    log.reset();
+    CHECK(log.live_message(50));
+    CHECK(log.live_message(20));
+    CHECK(log.backlog_message(10));
+    CHECK(!log.backlog_message(20));
+    CHECK(log.backlog_message(30));
+    CHECK(!log.backlog_message(50));
+    CHECK(log.backlog_message(60));
+    CHECK(log.cursor() == 60);
+    // strumień wysłał już 40, a writer dopiero teraz ją oddaje
+    CHECK(!log.live_message(40));
+    log.backlog_done();
+    CHECK(!log.streaming());
+    CHECK(log.live_message(61));
+    CHECK(!log.live_message(60));
+}
+
+// Klient bez Ack: oznaczamy to, czego zapis się zakończył.
+static void take_without_acks() {
+    DeliveryLog log;
+    log.reset();
+    log.backlog_done();
+    for (sqlite3_int64 id : {4, 2, 8}) log.written(id);
+    CHECK(log.take(2) == (Ids{4, 2}));
+    CHECK(log.take(5) == Ids{8});
+    CHECK(log.take(1).empty());
+}
+
+// Nowe logowanie porzuca niepotwierdzone i zaczyna strumień od zera.
+static void reset_drops_unacked() {
+    DeliveryLog log;
+    log.reset();
+    log.backlog_message(5);
+    log.written(5);
+    log.reset();
+    CHECK(log.streaming());
+    CHECK(log.cursor() == 0);
+    CHECK(log.unacked() == 0);
+    CHECK(log.backlog_message(5));
+}
+
+int main() {
+    out_of_order_live_ack();
+    ack_marks_write_order_prefix();
+    backlog_streams_past_live();
+    take_without_acks();
+    reset_drops_unacked();
+    return report("delivery_log");
+}
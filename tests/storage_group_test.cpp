@@ -0,0 +1,93 @@
+// Regresje wysyłania do grupy przy podziale na shardy (server/db/Storage).
+#include "../server/db/Storage.hpp"
+#include "check.hpp"
+#include <sqlite3.h>
+#include <cstdlib>
+#include <filesystem>
+#include <future>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static constexpr std::size_t kShards = 3;
+
+struct GroupResult {
+    std::vector<sqlite3_int64> ids;
+    bool complete = false;
+};
+
+// po jednym użytkowniku w każdym shardzie: names[i] trafia do shardu i
+static std::vector<std::string> one_user_per_shard() {
+    std::vector<std::string> names(kShards);
+    std::size_t found = 0;
+    for (int n = 0; found < kShards; ++n) {
+        std::string name = "u" + std::to_string(n);
+        auto& slot = names[Storage::shard_index(name, kShards)];
+        if (slot.empty()) { slot = name; ++found; }
+    }
+    return names;
+}
+
+static GroupResult send_group(Storage& storage, const std::string& from, const GroupRecord& rec, const std::string& content) {
+    std::promise<GroupResult> result;
+    storage.save_group_message(from, "g", rec, content, [&result](std::vector<sqlite3_int64> ids, bool complete) {
+        result.set_value({std::move(ids), complete});
+    });
+    return result.get_future().get();
+}
+
+// każdy INSERT do messages w tym pliku kończy się błędem
+static void break_shard(const std::string& path) {
+    sqlite3* db = nullptr;
+    sqlite3_open(path.c_str(), &db);
+    sqlite3_busy_timeout(db, 5000);
+    char* err = nullptr;
+    int rc = sqlite3_exec(db, "CREATE TRIGGER fail_insert BEFORE INSERT ON messages BEGIN SELECT RAISE(ABORT, 'injected'); END;",
+                          nullptr, nullptr, &err);
+    CHECK(rc == SQLITE_OK);
+    sqlite3_free(err);
+    sqlite3_close(db);
+}
+
+int main() {
+    std::string tmpl = (fs::temp_directory_path() / "chat_storage_test.XXXXXX").string();
+    if (!mkdtemp(tmpl.data())) { std::cerr << "mkdtemp failed\n"; return 1; }
+    fs::path dir = tmpl;
+    std::string path = (dir / "chat.db").string();
+    {
+        DatabaseOptions opts;
+        opts.readers = 1;
+        opts.synchronous = "OFF";
+        Storage storage(path, kShards, opts, 16, std::chrono::microseconds(0));
+        auto users = one_user_per_shard();
+        GroupRecord rec;
+        rec.id = 1;
+        rec.members = users;
+        const std::string& from = users[0];
+
+        // wszystkie shardy zdrowe: oryginał i obie kopie
+        GroupResult ok = send_group(storage, from, rec, "hello");
+        CHECK(ok.complete);
+        for (std::size_t i = 0; i < kShards; ++i) CHECK(ok.ids[i] != 0);
+
+        // kopia w shardzie 2 nie przechodzi (także po ponowieniu): wynik niepełny,
+        // a zapisane shardy zachowują swoje id
+        break_shard(Storage::shard_path(path, 2));
+        GroupResult partial = send_group(storage, from, rec, "partial");
+        CHECK(!partial.complete);
+        CHECK(partial.ids[0] != 0);
+        CHECK(partial.ids[1] != 0);
+        CHECK(partial.ids[2] == 0);
+        CHECK(storage.get_undelivered(users[1], 0, 10).size() == 2);
+        CHECK(storage.get_undelivered(users[2], 0, 10).size() == 1);
+
+        // shard nadawcy zawodzi: też niepełny, bez oryginału
+        GroupResult origin = send_group(storage, users[2], rec, "origin");
+        CHECK(!origin.complete);
+        CHECK(origin.ids[2] == 0);
+    }
+    fs::remove_all(dir);
+    return report("storage_group");
+}
@@ -0,0 +1,215 @@
+// Przepisuje bazę czatu na inną liczbę shardów (--shards 1 = z powrotem jeden plik).
+//
+//   chat_reshard --db chat.db --out chat4.db --shards 4
+//
+// Serwer musi być zatrzymany. Źródło jest tylko czytane (poza migracją do
+// bieżącego schematu, jak przy starcie serwera; układu shardów nie zapisujemy);
+// wynik powstaje obok, w --out i jego plikach shardów, które nie mogą jeszcze
+// istnieć. Potem serwer startuje z --db chat4.db --shards 4.
+//
+// Wiadomość bezpośrednia trafia do shardu odbiorcy. Oryginał wiadomości grupowej
+// do shardu nadawcy, a wiersze dostarczeń do shardów swoich odbiorców - z kopią
+// wiadomości (is_copy = 1, to samo id) tam, gdzie oryginału nie ma. Id zostają
+// bez zmian, więc kursory klientów i stronicowanie historii nadal działają.
+#include <sqlite3.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../server/db/Database.hpp"
+#include "../server/db/Migrations.hpp"
+#include "../server/db/Storage.hpp"
+
+namespace {
+
+struct Options {
+    std::string db = "chat.db";
+    std::string out;
+    std::size_t shards = 0;
+};
+
+Options parse_options(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) throw std::invalid_argument("missing value for " + arg);
+        std::string val = argv[++i];
+        if (arg == "--db") o.db = val;
+        else if (arg == "--out") o.out = val;
+        else if (arg == "--shards") o.shards = std::stoul(val);
+        else throw std::invalid_argument("unknown option " + arg);
+    }
+    if (o.out.empty() || o.shards < 1) throw std::invalid_argument("usage: chat_reshard --db chat.db --out NEW.db --shards N");
+    if (o.out == o.db) throw std::invalid_argument("--out must differ from --db");
+    return o;
+}
+
+bool exists(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+// pliki z wiadomościami: sam katalog albo jego shardy
+std::vector<std::string> message_files(const std::string& path, std::size_t shards) {
+    if (shards == 1) return {path};
+    std::vector<std::string> files;
+    for (std::size_t i = 0; i < shards; ++i) files.push_back(Storage::shard_path(path, i));
+    return files;
+}
+
+void exec(sqlite3* db, const std::string& sql) {
+    char* err = nullptr;
+    if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &err) != SQLITE_OK) {
+        std::string msg = err ? err : "unknown error";
+        sqlite3_free(err);
+        throw std::runtime_error(msg);
+    }
+}
+
+sqlite3_int64 count(sqlite3* db, const char* sql) {
+    Statement stmt(db, sql);
+    StatementScope q(stmt);
+    return q.step() == SQLITE_ROW ? q.int64(0) : 0;
+}
+
+// chat_shard(username) - ten sam podział co w serwerze
+void shard_function(sqlite3_context* ctx, int, sqlite3_value** argv) {
+    auto shards = *static_cast<std::size_t*>(sqlite3_user_data(ctx));
+    auto text = reinterpret_cast<const char*>(sqlite3_value_text(argv[0]));
+    std::string user = text ? std::string(text, static_cast<std::size_t>(sqlite3_value_bytes(argv[0]))) : "";
+    sqlite3_result_int64(ctx, static_cast<sqlite3_int64>(Storage::shard_index(user, shards)));
+}
+
+SqliteHandle open_target(const std::string& path, std::size_t* shards) {
+    sqlite3* raw = nullptr;
+    int rc = sqlite3_open_v2(path.c_str(), &raw, SQLITE_OPEN_READWRITE, nullptr);
+    SqliteHandle db(raw);
+    if (rc != SQLITE_OK) throw std::runtime_error("cannot open " + path);
+    sqlite3_create_function(db.get(), "chat_shard", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, shards, shard_function, nullptr, nullptr);
+    exec(db.get(), "PRAGMA synchronous = OFF;");
+    return db;
+}
+
+// Liczba shardów źródła bez zapisu do niego: brak wiersza storage_layout (albo
+// tabeli, sprzed migracji) to baza z jednego pliku.
+std::size_t source_layout(const std::string& path) {
+    sqlite3* raw = nullptr;
+    int rc = sqlite3_open_v2(path.c_str(), &raw, SQLITE_OPEN_READONLY, nullptr);
+    SqliteHandle db(raw);
+    if (rc != SQLITE_OK) throw std::runtime_error("cannot open " + path);
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db.get(), "SELECT shards FROM storage_layout;", -1, &stmt, nullptr) != SQLITE_OK) return 1;
+    std::size_t shards = sqlite3_step(stmt) == SQLITE_ROW ? static_cast<std::size_t>(sqlite3_column_int64(stmt, 0)) : 1;
+    sqlite3_finalize(stmt);
+    return shards;
+}
+
+void attach(sqlite3* db, const std::string& path) {
+    Statement stmt(db, "ATTACH DATABASE ? AS src;");
+    StatementScope q(stmt);
+    q.bind(1, path);
+    if (q.step() != SQLITE_DONE) throw std::runtime_error("cannot attach " + path + ": " + sqlite3_errmsg(db));
+}
+
+// ATTACH/DETACH nie mogą być w otwartej transakcji, więc transakcja jest w środku
+void copy_catalog(sqlite3* db, const std::string& source) {
+    attach(db, source);
+    exec(db,
+         "BEGIN;"
+         "INSERT INTO users (id, username, salt, hash, iterations) SELECT id, username, salt, hash, iterations FROM src.users;"
+         "INSERT INTO groups (id, name) SELECT id, name FROM src.groups;"
+         "INSERT INTO group_members (group_id, user_id) SELECT group_id, user_id FROM src.group_members;"
+         "COMMIT;");
+    exec(db, "DETACH DATABASE src;");
+}
+
+void copy_messages(sqlite3* db, const std::string& source, std::size_t target) {
+    std::string t = std::to_string(target);
+    attach(db, source);
+    exec(db,
+         "BEGIN;"
+         "INSERT INTO messages (id, sender, receiver, content, ts, delivered, group_id, is_copy) "
+         "SELECT id, sender, receiver, content, ts, delivered, group_id, 0 FROM src.messages "
+         "WHERE group_id IS NULL AND chat_shard(receiver) = " + t + ";"
+         // ten sam wiersz grupowy z kilku źródeł (kopie po wcześniejszym reshardzie): oryginał wygrywa
+         "INSERT INTO messages (id, sender, receiver, content, ts, delivered, group_id, is_copy) "
+         "SELECT id, sender, receiver, content, ts, delivered, group_id, "
+         "CASE WHEN is_copy = 0 AND chat_shard(sender) = " + t + " THEN 0 ELSE 1 END FROM src.messages m "
+         "WHERE group_id IS NOT NULL AND ((is_copy = 0 AND chat_shard(sender) = " + t + ") OR EXISTS "
+         "(SELECT 1 FROM src.message_deliveries d WHERE d.message_id = m.id AND chat_shard(d.receiver) = " + t + ")) "
+         "ON CONFLICT(id) DO UPDATE SET is_copy = MIN(is_copy, excluded.is_copy);"
+         "INSERT OR IGNORE INTO message_deliveries (message_id, receiver, delivered) "
+         "SELECT message_id, receiver, delivered FROM src.message_deliveries WHERE chat_shard(receiver) = " + t + ";"
+         "COMMIT;");
+    exec(db, "DETACH DATABASE src;");
+}
+
+const char* kOriginals = "SELECT COUNT(*) FROM messages WHERE is_copy = 0;";
+const char* kDeliveries = "SELECT COUNT(*) FROM message_deliveries;";
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        Options opts = parse_options(argc, argv);
+        auto started = std::chrono::steady_clock::now();
+
+        if (!exists(opts.db)) throw std::runtime_error(opts.db + " does not exist");
+        std::size_t source_shards = source_layout(opts.db);
+        if (source_shards < 1) throw std::runtime_error(opts.db + " has an invalid storage layout");
+        sqlite3_int64 originals = 0, deliveries = 0;
+        {
+            // migracja plików źródła do bieżącego schematu, jak przy starcie serwera
+            Database catalog(opts.db);
+            if (source_shards > 1) {
+                DatabaseOptions shard_opts;
+                shard_opts.foreign_keys = false;
+                for (const auto& f : message_files(opts.db, source_shards)) {
+                    if (!exists(f)) throw std::runtime_error(f + " does not exist");
+                    Database shard(f, shard_opts);
+                }
+            }
+        }
+        for (const auto& f : message_files(opts.db, source_shards)) {
+            auto db = open_target(f, &source_shards);
+            originals += count(db.get(), kOriginals);
+            deliveries += count(db.get(), kDeliveries);
+        }
+
+        auto targets = message_files(opts.out, opts.shards);
+        if (opts.shards > 1) targets.insert(targets.begin(), opts.out);
+        for (const auto& f : targets) {
+            if (exists(f)) throw std::runtime_error(f + " already exists");
+        }
+        { Storage create(opts.out, opts.shards, DatabaseOptions(), 1, std::chrono::microseconds(0)); }
+
+        auto catalog = open_target(opts.out, &opts.shards);
+        copy_catalog(catalog.get(), opts.db);
+
+        sqlite3_int64 out_originals = 0, out_deliveries = 0;
+        auto shard_files = message_files(opts.out, opts.shards);
+        for (std::size_t t = 0; t < shard_files.size(); ++t) {
+            auto db = open_target(shard_files[t], &opts.shards);
+            for (const auto& f : message_files(opts.db, source_shards)) copy_messages(db.get(), f, t);
+            // liczniki z triggerów nie widzą połączonych kopii, więc od zera
+            rebuild_user_stats(db.get());
+            out_originals += count(db.get(), kOriginals);
+            out_deliveries += count(db.get(), kDeliveries);
+            std::cout << shard_files[t] << ": " << count(db.get(), "SELECT COUNT(*) FROM messages;") << " messages\n";
+        }
+        if (out_originals != originals || out_deliveries != deliveries) {
+            throw std::runtime_error("row counts differ: messages " + std::to_string(originals) + " -> " + std::to_string(out_originals) +
+                                     ", deliveries " + std::to_string(deliveries) + " -> " + std::to_string(out_deliveries));
+        }
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+        std::cout << "Resharded " << originals << " messages and " << deliveries << " deliveries from " << source_shards
+                  << " to " << opts.shards << " shard(s) in " << ms << " ms\n";
+    } catch (std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}